@@ -1,11 +1,16 @@
 #include <algorithm>
 #include <boost/program_options.hpp>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <fstream>
+#include <streambuf>
+#include <thread>
 
 #include <io/netmp.h>
+#include <graphsc/offline_evaluator.h>
+#include <graphsc/preproc_store.h>
 
 #include "utils.h"
 #include "benchmark.h"
@@ -14,7 +19,8 @@
 bpo::options_description bench::programOptions() {
     bpo::options_description desc("Following options are supported by config file too. Regarding seeds, all, 01, 02, and 12 need to be equal among the parties using them. Other parties, e.g., party 2 for seed 01 can take any value and in fact must not know the value that 0 and 1 use");
     desc.add_options()
-        ("pid,p", bpo::value<size_t>()->required(), "Party ID.")
+        ("pid,p", bpo::value<size_t>(), "Party ID, required unless --in-process is given.")
+        ("in-process", bpo::bool_switch(), "Run all parties as threads of this process, only the output of P1 is shown. Implies --localhost and uses --transport shm unless a transport is given.")
         ("threads,t", bpo::value<size_t>()->default_value(6), "Number of threads (recommended 6).")
         ("seed_self_h", bpo::value<uint64_t>()->default_value(100), "Value of the private random seed, high bits.")
         ("seed_self_l", bpo::value<uint64_t>()->default_value(0), "Value of the random seed, low bits (will add pid if 0/default).")
@@ -34,6 +40,19 @@ bpo::options_description bench::programOptions() {
         ("trusted_cert_path", bpo::value<std::string>()->default_value("certs/cert_ca.pem"), "Path with trusted certificate for TLS client connections")
 
         ("port", bpo::value<int>()->default_value(10000), "Base port for networking.")
+        ("streams", bpo::value<int>()->default_value(1), "Number of parallel TLS connections per pair of parties and direction, large messages are striped across them. Uses ports up to port + 18 * streams.")
+        ("async-net", bpo::bool_switch(), "Use the asynchronous network backend, which overlaps the send and receive segments of the online phase.")
+        ("ktls", bpo::bool_switch(), "Offload TLS record encryption to the kernel where supported, falls back to OpenSSL otherwise.")
+        ("connect-timeout", bpo::value<double>()->default_value(120), "Seconds to wait for the other parties to connect before giving up, 0 to wait as long as it takes.")
+        ("wan-latency", bpo::value<double>()->default_value(0), "Emulated one-way latency in ms added to all data sent between the parties, without tc or special privileges.")
+        ("wan-jitter", bpo::value<double>()->default_value(0), "Emulated jitter in ms, each packet is delayed by up to this much more or less than --wan-latency.")
+        ("wan-bandwidth", bpo::value<double>()->default_value(0), "Emulated bandwidth in MBit/s per pair of parties and direction, 0 for unlimited.")
+        ("transport", bpo::value<std::string>()->default_value("tls"), "Connections between the parties: TLS over TCP (tls), plain TCP without encryption and authentication for trusted networks (tcp), or shared memory for parties on the same host, requires --localhost (shm).")
+        ("lazy-preproc", bpo::bool_switch(), "Keep the preprocessing of P1/P2 seed-compressed and expand it level by level during the online phase.")
+        ("preproc-mode", bpo::value<std::string>()->default_value("both"), "Run offline and online phase (both), both phases concurrently (concurrent), only the offline phase storing the preprocessing (offline), or only the online phase loading it (online).")
+        ("balanced-dealer", bpo::bool_switch(), "Split the offline communication of P0 evenly between P1 and P2.")
+        ("preproc-queue", bpo::value<size_t>()->default_value(8), "Number of levels of preprocessing buffered with --preproc-mode concurrent.")
+        ("preproc-file", bpo::value<std::string>(), "File for stored preprocessing, defaults to preproc_p[PID].bin.")
         ("output,o", bpo::value<std::string>(), "File to save benchmarks.")
         ("repeat,r", bpo::value<size_t>()->default_value(1), "Number of times to run benchmarks.");
 
@@ -65,9 +84,15 @@ bpo::variables_map bench::parseOptions(bpo::options_description& cmdline, bpo::o
     try {
         bpo::notify(opts);
 
-        if (!opts["localhost"].as<bool>() && (opts.count("net-config") == 0)) {
+        if (opts.count("pid") == 0 && !inProcess(opts)) {
+            throw std::runtime_error("Expected one of 'pid' or 'in-process'");
+        }
+        if (!opts["localhost"].as<bool>() && (opts.count("net-config") == 0) && !inProcess(opts)) {
             throw std::runtime_error("Expected one of 'localhost' or 'net-config'");
         }
+        if (opts["preproc-mode"].as<std::string>() == "online" && opts["repeat"].as<size_t>() > 1) {
+            throw std::runtime_error("Stored preprocessing can only be used once, run --preproc-mode online without --repeat");
+        }
     } catch (const std::exception& ex) {
         std::cerr << ex.what() << std::endl;
         throw std::runtime_error("Error occured");
@@ -103,14 +128,31 @@ void bench::setupBenchmark(const bpo::variables_map& opts, size_t& pid, size_t&
     seeds_l[4] = opts["seed_12_l"].as<uint64_t>();
 
     repeat = opts["repeat"].as<size_t>();
-    auto port = opts["port"].as<int>();
+    network = connectNetwork(opts, pid, opts["port"].as<int>(), opts["ktls"].as<bool>(), opts["transport"].as<std::string>());
+}
+
+std::shared_ptr<io::NetIOMP> bench::connectNetwork(const bpo::variables_map& opts, size_t pid, int port, bool ktls,
+        const std::string& transport) {
+    auto streams = opts["streams"].as<int>();
+    auto timeout = opts["connect-timeout"].as<double>();
+    io::Transport kind;
+    if (transport == "tls") {
+        kind = io::kTLS;
+    } else if (transport == "tcp") {
+        kind = io::kTCP;
+    } else if (transport == "shm") {
+        kind = io::kShm;
+    } else {
+        throw std::runtime_error("Unknown transport " + transport);
+    }
 
     auto certificate_path = opts["certificate_path"].as<std::string>();
     auto private_key_path = opts["private_key_path"].as<std::string>();
     auto trusted_cert_path = opts["trusted_cert_path"].as<std::string>();
 
+    std::shared_ptr<io::NetIOMP> network;
     if (opts["localhost"].as<bool>()) {
-        network = std::make_shared<io::NetIOMP>(pid, 3, port, nullptr, certificate_path, private_key_path, trusted_cert_path, true);
+        network = std::make_shared<io::NetIOMP>(pid, 3, port, nullptr, certificate_path, private_key_path, trusted_cert_path, true, streams, ktls, kind, timeout);
     }
     else {
         std::ifstream fnet(opts["net-config"].as<std::string>());
@@ -129,6 +171,146 @@ void bench::setupBenchmark(const bpo::variables_map& opts, size_t& pid, size_t&
             ip[i] = ipaddress[i].data();
         }
 
-        network = std::make_shared<io::NetIOMP>(pid, 3, port, ip.data(), certificate_path, private_key_path, trusted_cert_path, false);
+        network = std::make_shared<io::NetIOMP>(pid, 3, port, ip.data(), certificate_path, private_key_path, trusted_cert_path, false, streams, ktls, kind, timeout);
+    }
+
+    io::WanProfile wan;
+    wan.latency_ms = opts["wan-latency"].as<double>();
+    wan.jitter_ms = opts["wan-jitter"].as<double>();
+    wan.bandwidth_mbit = opts["wan-bandwidth"].as<double>();
+    if (wan.enabled()) {
+        network->emulateWan(wan);
+    }
+
+    if (opts["async-net"].as<bool>()) {
+        network->enableAsync();
+    }
+    return network;
+}
+
+std::tuple<graphsc::PreprocCircuit<Ring>, json> bench::runPreprocessing(const bpo::variables_map& opts, size_t pid, size_t threads,
+        std::shared_ptr<io::NetIOMP> network, const common::utils::LevelOrderedCircuit& circ, uint64_t* seeds_h, uint64_t* seeds_l,
+        const std::unordered_map<common::utils::wire_t, int>& input_to_pid) {
+    auto mode = opts["preproc-mode"].as<std::string>();
+    auto lazy = opts["lazy-preproc"].as<bool>();
+    std::string preproc_file = "preproc_p" + std::to_string(pid) + ".bin";
+    if (opts.count("preproc-file") != 0) {
+        preproc_file = opts["preproc-file"].as<std::string>();
+    }
+
+    if (mode == "online") {
+        std::string note;
+        auto preproc = graphsc::loadPreproc(preproc_file, pid, circ, !lazy, &note);
+        network->sync();
+        return {std::move(preproc), json::parse(note)};
+    }
+    if (mode != "both" && mode != "offline" && mode != "concurrent") {
+        throw std::runtime_error("Unknown preproc-mode " + mode);
+    }
+
+    graphsc::OfflineEvaluator off_eval(pid, network, circ, threads, seeds_h, seeds_l);
+    // Only the seed-compressed form can be stored
+    off_eval.setLazyExpansion(lazy || mode == "offline");
+    off_eval.setBalancedDealer(opts["balanced-dealer"].as<bool>());
+    if (mode == "concurrent") {
+        off_eval.setPipelined(opts["preproc-queue"].as<size_t>());
+    }
+    StatsPoint start_pre(*network);
+    auto preproc = off_eval.run(input_to_pid);
+    StatsPoint end_pre(*network);
+    // With concurrent phases, P1 and P2 still receive from P0 in the background
+    if (mode != "concurrent") {
+        network->sync();
+    }
+    auto rbench_pre = end_pre - start_pre;
+
+    if (mode == "offline") {
+        graphsc::savePreproc(preproc_file, pid, circ, preproc, rbench_pre.dump());
+        std::cout << "stored preprocessing in " << preproc_file << std::endl;
+    }
+    return {std::move(preproc), rbench_pre};
+}
+
+bool bench::runsOnline(const bpo::variables_map& opts) {
+    return opts["preproc-mode"].as<std::string>() != "offline";
+}
+
+namespace {
+// Output of the threads of P0 and P2 with --in-process is dropped, just as
+// run_test.sh discards the output of their processes.
+thread_local bool mute_output = false;
+
+class PartyOutputFilter : public std::streambuf {
+    std::streambuf* target_;
+
+  protected:
+    int overflow(int c) override {
+        if (mute_output || c == traits_type::eof()) {
+            return traits_type::not_eof(c);
+        }
+        return target_->sputc(traits_type::to_char_type(c));
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        return mute_output ? n : target_->sputn(s, n);
+    }
+
+    int sync() override { return target_->pubsync(); }
+
+  public:
+    explicit PartyOutputFilter(std::streambuf* target) : target_(target) {}
+};
+
+template <class T>
+void setOption(bpo::variables_map& opts, const std::string& name, const T& value) {
+    opts.erase(name);
+    opts.insert({name, bpo::variable_value(boost::any(value), false)});
+}
+}
+
+bool bench::inProcess(const bpo::variables_map& opts) {
+    return opts.count("in-process") != 0 && opts["in-process"].as<bool>();
+}
+
+int bench::runParties(const bpo::variables_map& opts, const std::function<void(const bpo::variables_map&)>& benchmark) {
+    if (!inProcess(opts)) {
+        try {
+            benchmark(opts);
+        } catch (const std::exception& ex) {
+            std::cerr << ex.what() << "\nFatal error" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    PartyOutputFilter filter(std::cout.rdbuf());
+    auto* original = std::cout.rdbuf(&filter);
+    std::vector<std::thread> parties;
+    for (size_t pid = 0; pid < 3; ++pid) {
+        auto party_opts = opts;
+        setOption(party_opts, "pid", pid);
+        setOption(party_opts, "localhost", true);
+        if (opts["transport"].defaulted()) {
+            setOption(party_opts, "transport", std::string("shm"));
+        }
+        if (pid != 1) {
+            party_opts.erase("output");
+        }
+        parties.emplace_back([party_opts, pid, &benchmark]() {
+            mute_output = pid != 1;
+            try {
+                benchmark(party_opts);
+            } catch (const std::exception& ex) {
+                std::cerr << "P" << pid << ": " << ex.what() << "\nFatal error" << std::endl;
+                std::cout.flush();
+                // The other parties would wait for this one forever
+                std::_Exit(1);
+            }
+        });
+    }
+    for (auto& party : parties) {
+        party.join();
     }
+    std::cout.rdbuf(original);
+    return 0;
 }
@@ -1,6 +1,12 @@
 #pragma once
 
 #include <boost/program_options.hpp>
+#include <graphsc/preproc.h>
+#include <utils/circuit.h>
+
+#include <functional>
+#include <tuple>
+#include <unordered_map>
 
 namespace bpo = boost::program_options;
 
@@ -13,4 +19,28 @@ namespace bench {
 
     // pid, repeat, threads, network, seeds_h, seeds_l, output_data, save_output, save_file
     void setupBenchmark(const bpo::variables_map& opts, size_t& pid, size_t& repeat, size_t& threads, std::shared_ptr<io::NetIOMP>& network, uint64_t* seeds_h, uint64_t* seeds_l, bool& save_output, std::string& save_file);
+
+    // Connects to the other parties as configured in opts (localhost or net-config, streams,
+    // async-net), using the given base port, kTLS setting and transport (tls, tcp or shm).
+    std::shared_ptr<io::NetIOMP> connectNetwork(const bpo::variables_map& opts, size_t pid, int port, bool ktls,
+        const std::string& transport);
+
+    // Obtains the preprocessing according to --preproc-mode: runs the offline phase ("both"),
+    // starts it to run alongside the online phase ("concurrent"), runs it and stores the result
+    // in --preproc-file ("offline"), or loads it from there ("online").
+    // Also returns the statistics of the offline run, which are stored with the preprocessing.
+    std::tuple<graphsc::PreprocCircuit<Ring>, json> runPreprocessing(const bpo::variables_map& opts, size_t pid, size_t threads,
+        std::shared_ptr<io::NetIOMP> network, const common::utils::LevelOrderedCircuit& circ, uint64_t* seeds_h, uint64_t* seeds_l,
+        const std::unordered_map<common::utils::wire_t, int>& input_to_pid);
+
+    // Whether the online phase is run according to --preproc-mode.
+    bool runsOnline(const bpo::variables_map& opts);
+
+    // Whether all parties run as threads of this process (--in-process).
+    bool inProcess(const bpo::variables_map& opts);
+
+    // Runs benchmark for the party given by --pid, or with --in-process for all
+    // three parties as threads of this process, each with its own copy of opts.
+    // Returns the exit code for main.
+    int runParties(const bpo::variables_map& opts, const std::function<void(const bpo::variables_map&)>& benchmark);
 }
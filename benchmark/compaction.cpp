@@ -118,13 +118,7 @@ void benchmark(const bpo::variables_map& opts) {
     for (size_t r = 0; r < repeat; ++r) {
         std::cout << "--- Repetition " << r + 1 << " ---" << std::endl;
 
-        OfflineEvaluator off_eval(pid, network, circ, threads, seeds_h, seeds_l);
-        StatsPoint start_pre(*network);
-        auto preproc = off_eval.run(input_to_pid);
-        StatsPoint end_pre(*network);
-        network->sync();
-
-        auto rbench_pre = end_pre - start_pre;
+        auto [preproc, rbench_pre] = bench::runPreprocessing(opts, pid, threads, network, circ, seeds_h, seeds_l, input_to_pid);
         output_data["benchmarks_pre"].push_back(rbench_pre);
         size_t bytes_sent_pre = 0;
         for (const auto& val : rbench_pre["communication"]) {
@@ -133,6 +127,10 @@ void benchmark(const bpo::variables_map& opts) {
         std::cout << "setup time: " << rbench_pre["time"] << " ms" << std::endl;
         std::cout << "setup sent: " << bytes_sent_pre << " bytes" << std::endl;
         
+        if (!bench::runsOnline(opts)) {
+            continue;
+        }
+
         OnlineEvaluator eval(pid, network, std::move(preproc), circ, 
                     threads, seeds_h, seeds_l);
         StatsPoint start(*network);
@@ -215,16 +213,9 @@ int main(int argc, char* argv[]) {
       "help,h", "produce help message") ("vec-size,v", bpo::value<size_t>()->required(), "Number of vector elements.");
 
     bpo::variables_map opts = bench::parseOptions(cmdline, prog_opts, argc, argv);
-    if (opts.count("pid") == 0) {
+    if (opts.count("pid") == 0 && !bench::inProcess(opts)) {
         return 0; // Help page etc.
     }
 
-    try {
-        benchmark(opts);
-    } catch (const std::exception& ex) {
-        std::cerr << ex.what() << "\nFatal error" << std::endl;
-        return 1;
-    }
-
-    return 0;
+    return bench::runParties(opts, benchmark);
 }
@@ -23,8 +23,8 @@ std::tuple<common::utils::LevelOrderedCircuit, std::vector<std::vector<std::vect
     common::utils::Circuit<Ring> circ;
 
     // This inherits the communication from subcirc::pi_3_ref + 4n bytes online and 1 round for the output layer
-    // 4*n^2*(D+l-2) bytes setup
-    // 8*n^2*(D+l-2) + 4*n bytes online
+    // 4n^2*(l-1) + 4n*(D-1) bytes setup
+    // 8n^2*(l-1) + 4(n^2+n)*(D-1) + 4n bytes online
     // D + ceil(log2(l)) - 1 + 1 rounds
 
     std::vector<std::vector<std::vector<common::utils::wire_t>>> adj_matrices(l);
@@ -147,13 +147,7 @@ void benchmark(const bpo::variables_map& opts) {
     for (size_t r = 0; r < repeat; ++r) {
         std::cout << "--- Repetition " << r + 1 << " ---" << std::endl;
 
-        OfflineEvaluator off_eval(pid, network, circ, threads, seeds_h, seeds_l);
-        StatsPoint start_pre(*network);
-        auto preproc = off_eval.run(input_to_pid);
-        StatsPoint end_pre(*network);
-        network->sync();
-
-        auto rbench_pre = end_pre - start_pre;
+        auto [preproc, rbench_pre] = bench::runPreprocessing(opts, pid, threads, network, circ, seeds_h, seeds_l, input_to_pid);
         output_data["benchmarks_pre"].push_back(rbench_pre);
         size_t bytes_sent_pre = 0;
         for (const auto& val : rbench_pre["communication"]) {
@@ -162,6 +156,10 @@ void benchmark(const bpo::variables_map& opts) {
         std::cout << "setup time: " << rbench_pre["time"] << " ms" << std::endl;
         std::cout << "setup sent: " << bytes_sent_pre << " bytes" << std::endl;
         
+        if (!bench::runsOnline(opts)) {
+            continue;
+        }
+
         OnlineEvaluator eval(pid, network, std::move(preproc), circ, 
                     threads, seeds_h, seeds_l);
         StatsPoint start(*network);
@@ -181,11 +179,11 @@ void benchmark(const bpo::variables_map& opts) {
             assert(res[2] == 20510023); // 2 of length 1, 5 of length 2, 10 of length 3, 23 of length 4
             assert(res[3] == 10305013); // 1 of length 1, 3 of length 2,  5 of length 3, 13 of length 4
 
-            assert(bytes_sent == 8*n*n*(weights.size() + l - 2) + 4*n);
+            assert(bytes_sent == 8*n*n*(l-1) + 4*(n*n+n)*(weights.size()-1) + 4*n);
             assert(bytes_sent_pre == 0);
         } else {
             assert(bytes_sent == 0);
-            assert(bytes_sent_pre - 56 == 4*n*n*(weights.size() + l - 2)); // 56 always sent to synchronize vector sizes
+            assert(bytes_sent_pre - 56 == 4*n*n*(l-1) + 4*n*(weights.size()-1)); // 56 always sent to synchronize vector sizes
         }
         assert(circ.gates_by_level.size() == weights.size() + log_l);
 
@@ -221,16 +219,9 @@ int main(int argc, char* argv[]) {
       "help,h", "produce help message");
 
     bpo::variables_map opts = bench::parseOptions(cmdline, prog_opts, argc, argv);
-    if (opts.count("pid") == 0) {
+    if (opts.count("pid") == 0 && !bench::inProcess(opts)) {
         return 0; // Help page etc.
     }
 
-    try {
-        benchmark(opts);
-    } catch (const std::exception& ex) {
-        std::cerr << ex.what() << "\nFatal error" << std::endl;
-        return 1;
-    }
-
-    return 0;
+    return bench::runParties(opts, benchmark);
 }
@@ -293,19 +293,13 @@ std::vector<common::utils::wire_t> subcirc::pi_3_reference( std::vector<std::vec
         s_accu.push_back(circ.addConstOpGate(common::utils::GateType::kConstMul, s[i], weights[0]));
     }
     for (size_t k = 1; k < weights.size(); k++) {
-        std::vector<std::vector<common::utils::wire_t>> products;
+        // n dot products opening B and s once, 4n^2 + 4n bytes online and 4n bytes setup, single round
+        std::vector<common::utils::wire_t> products;
         for (size_t i = 0; i < n; i++) {
-            products.push_back(std::vector<common::utils::wire_t>());
-            for (size_t j = 0; j < n; j++) {
-                products[i].push_back(circ.addGate(common::utils::GateType::kMul, B[i][j], s[j]));
-            }
+            products.push_back(circ.addGate(common::utils::GateType::kDotprod, B[i], s));
         }
         for (size_t i = 0; i < n; i++) {
-            auto accu = products[i][0];
-            for (size_t j = 1; j < n; j++) {
-                accu = circ.addGate(common::utils::GateType::kAdd, accu, products[i][j]);
-            }
-            s[i] = accu;
+            s[i] = products[i];
             auto with_weight =  circ.addConstOpGate(common::utils::GateType::kConstMul, s[i], weights[k]);
             s_accu[i] = circ.addGate(common::utils::GateType::kAdd, s_accu[i], with_weight);
         }
@@ -501,8 +495,8 @@ std::vector<common::utils::wire_t> subcirc::pi_2_reference( std::vector<std::vec
 
     std::vector<std::vector<std::vector<common::utils::wire_t>>> wrapper;
     wrapper.push_back(A);
-    // 4*n^2*(D-1) bytes setup
-    // 8*n^2*(D-1) bytes online
+    // 4n*(D-1) bytes setup
+    // 4(n^2+n)*(D-1) bytes online
     // D - 1 rounds
     return pi_3_reference(wrapper, circ, n, weights);
 }
@@ -617,20 +611,22 @@ std::vector<common::utils::wire_t> subcirc::pi_1_reference( std::vector<std::vec
         }
     }
 
-    // 4n^3(D-1) + 8n^3(D-1) in (D-1) rounds
+    // Columns of B as inputs of the dot products
+    std::vector<std::vector<common::utils::wire_t>> B_cols(n);
+    for (size_t w = 0; w < n; w++) {
+        for (size_t v = 0; v < n; v++) {
+            B_cols[v].push_back(B[w][v]);
+        }
+    }
+
+    // 4n^2(D-1) + 4n^2(2D-3) in (D-1) rounds
     for (size_t k = 1; k < depth; k++) {
         std::vector<std::vector<common::utils::wire_t>> new_Bk(n);
-        // n^3 multiplications that are 4 + 8 bytes each, single round total
+        // n^2 dot products that open Bk and B once, single round total:
+        // 4 bytes setup each, 4n^2 bytes online for B and 4n^2 for Bk unless Bk is B
         for (size_t u = 0; u < n; u++) {
             for (size_t v = 0; v < n; v++) {
-                common::utils::wire_t accu;
-                for (size_t w = 0; w < n; w++) {
-                    auto prod = circ.addGate(common::utils::GateType::kMul, Bk[u][w], B[w][v]);
-                    if (w == 0)
-                        accu = prod;
-                    else
-                        accu = circ.addGate(common::utils::GateType::kAdd, accu, prod);
-                }
+                auto accu = circ.addGate(common::utils::GateType::kDotprod, Bk[u], B_cols[v]);
                 new_Bk[u].push_back(accu);
                 Bsum[u][v] = circ.addGate(common::utils::GateType::kAdd, Bsum[u][v], accu);
             }
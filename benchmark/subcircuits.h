@@ -79,8 +79,8 @@ namespace subcirc {
      * @param weights Weights for paths of length i+1, weights.size() also determines the search depth D
      * 
      * Communication:
-     * 4*n^2*(D-1) bytes setup
-     * 8*n^2*(D-1) bytes online
+     * 4n*(D-1) bytes setup
+     * 4(n^2+n)*(D-1) bytes online
      * D - 1 rounds
      */
     std::vector<common::utils::wire_t> pi_3_reference(  std::vector<std::vector<std::vector<common::utils::wire_t>>> &adj_matrices,
@@ -130,8 +130,8 @@ namespace subcirc {
      * @param weights Weights for paths of length i+1, weights.size() also determines the search depth D
      * 
      * Communication:
-     * 4*n^2*(D+l-2) bytes setup
-     * 8*n^2*(D+l-2) bytes online
+     * 4n^2*(l-1) + 4n*(D-1) bytes setup
+     * 8n^2*(l-1) + 4(n^2+n)*(D-1) bytes online
      * D + ceil(log2(l)) - 1 rounds
      */
     std::vector<common::utils::wire_t> pi_2_reference(  std::vector<std::vector<std::vector<common::utils::wire_t>>> &adj_matrices,
@@ -183,8 +183,8 @@ namespace subcirc {
      * @param depth Search depth D
      * 
      * Communication:
-     * 4n^3*(D-1)+24n^2 bytes setup
-     * 8n^3*(D-1)+48n^2 bytes online
+     * 4n^2*(D-1)+24n^2 bytes setup
+     * 4n^2*(2D-3)+48n^2 bytes online (48n^2 if D = 1)
      * D + 5 rounds
      */
     std::vector<common::utils::wire_t> pi_1_reference(  std::vector<std::vector<std::vector<common::utils::wire_t>>> &adj_matrices,
@@ -0,0 +1,144 @@
+#include <io/netmp.h>
+
+#include <boost/program_options.hpp>
+#include <cassert>
+#include <iostream>
+#include <memory>
+
+#include "utils.h"
+#include "benchmark.h"
+
+using json = nlohmann::json;
+namespace bpo = boost::program_options;
+
+/*
+Measures the raw channel throughput from P1 to P2, once with encryption in
+OpenSSL, once with kernel TLS offload (which falls back to OpenSSL if the
+kernel or OpenSSL lack support, reported as "ktls_send"/"ktls_recv"), once
+over plain TCP, which shows the cost of TLS itself, and, with --localhost,
+once through shared memory.
+P1 sends the data in chunks and waits for a 1 byte acknowledgement of P2,
+P0 only takes part in setting up the connections.
+*/
+
+json measure(const bpo::variables_map& opts, size_t pid, int port, const std::string& mode, size_t total, size_t chunk) {
+    bool ktls = mode == "ktls";
+    auto network = bench::connectNetwork(opts, pid, port, ktls, mode == "openssl" || ktls ? "tls" : mode);
+    std::vector<char> buffer(chunk);
+    for (size_t i = 0; i < chunk; i++) {
+        buffer[i] = static_cast<char>(i);
+    }
+    char ack = 1;
+
+    network->sync();
+    StatsPoint start(*network);
+    if (pid == 1) {
+        for (size_t done = 0; done < total; done += chunk) {
+            network->send(2, buffer.data(), std::min(chunk, total - done));
+        }
+        network->flush(2);
+        network->recv(2, &ack, 1);
+    } else if (pid == 2) {
+        for (size_t done = 0; done < total; done += chunk) {
+            network->recv(1, buffer.data(), std::min(chunk, total - done));
+        }
+        network->send(1, &ack, 1);
+        network->flush(1);
+    }
+    StatsPoint end(*network);
+    auto rbench = end - start;
+
+    size_t bytes_sent = 0;
+    for (const auto& val : rbench["communication"]) {
+        bytes_sent += val.get<int64_t>();
+    }
+    if (pid == 1) {
+        assert(bytes_sent == total);
+    } else if (pid == 2) {
+        assert(bytes_sent == 1);
+    } else {
+        assert(bytes_sent == 0);
+    }
+
+    auto* send_channel = dynamic_cast<io::StripedTLSNetIO*>(network->getSendChannel(pid == 1 ? 2 : 1));
+    auto* recv_channel = dynamic_cast<io::StripedTLSNetIO*>(network->getRecvChannel(pid == 1 ? 2 : 1));
+    bool ktls_send = pid == 0 || (send_channel != nullptr && send_channel->ktlsSend());
+    bool ktls_recv = pid == 0 || (recv_channel != nullptr && recv_channel->ktlsRecv());
+    rbench["mode"] = mode;
+    rbench["ktls_send"] = ktls_send;
+    rbench["ktls_recv"] = ktls_recv;
+    rbench["throughput"] = total / (rbench["time"].get<double>() * 1000);  // MB/s
+    network->sync();
+    return rbench;
+}
+
+void benchmark(const bpo::variables_map& opts) {
+    auto megabytes = opts["megabytes"].as<size_t>();
+    auto chunk = opts["chunk"].as<size_t>();
+    if (chunk == 0) {
+        throw std::invalid_argument("Chunk size must be positive");
+    }
+    size_t total = megabytes * 1000 * 1000;
+
+    auto pid = opts["pid"].as<size_t>();
+    auto repeat = opts["repeat"].as<size_t>();
+    auto port = opts["port"].as<int>();
+    // Each mode uses its own set of connections, above the ports of the previous one
+    int ports_per_mode = 18 * opts["streams"].as<int>();
+
+    json output_data;
+    output_data["details"] = {{"pid", pid},
+                              {"repeat", repeat},
+                              {"megabytes", megabytes},
+                              {"chunk", chunk},
+                              {"streams", opts["streams"].as<int>()}};
+    output_data["benchmarks"] = json::array();
+
+    std::cout << "--- Details ---\n";
+    for (const auto& [key, value] : output_data["details"].items()) {
+        std::cout << key << ": " << value << "\n";
+    }
+    std::cout << std::endl;
+
+    for (size_t r = 0; r < repeat; ++r) {
+        std::cout << "--- Repetition " << r + 1 << " ---" << std::endl;
+        int mode_port = port;
+        for (std::string mode : {"openssl", "ktls", "tcp", "shm"}) {
+            if (mode == "shm" && !opts["localhost"].as<bool>()) {
+                continue;
+            }
+            auto rbench = measure(opts, pid, mode_port, mode, total, chunk);
+            mode_port += ports_per_mode;
+            output_data["benchmarks"].push_back(rbench);
+            std::cout << rbench["mode"].get<std::string>() << " (kernel send: " << rbench["ktls_send"]
+                      << ", kernel recv: " << rbench["ktls_recv"] << ")" << std::endl;
+            std::cout << "time: " << rbench["time"] << " ms" << std::endl;
+            std::cout << "throughput: " << rbench["throughput"] << " MB/s" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    if (opts.count("output") != 0) {
+        saveJson(output_data, opts["output"].as<std::string>());
+    }
+}
+
+int main(int argc, char* argv[]) {
+    auto prog_opts(bench::programOptions());
+    bpo::options_description cmdline(
+      "Benchmark the channel throughput from P1 to P2 with TLS in OpenSSL, TLS in the kernel, plain TCP and shared memory");
+    cmdline.add(prog_opts);
+    cmdline.add_options()(
+      "config,c", bpo::value<std::string>(),
+      "configuration file for easy specification of cmd line arguments")(
+      "help,h", "produce help message")
+      ("megabytes", bpo::value<size_t>()->default_value(256), "Amount of data to send in MB.")
+      ("chunk", bpo::value<size_t>()->default_value(1 << 20), "Size of a single send in bytes.");
+
+    bpo::variables_map opts = bench::parseOptions(cmdline, prog_opts, argc, argv);
+    if (opts.count("pid") == 0 && !bench::inProcess(opts)) {
+        return 0; // Help page etc.
+    }
+
+    return bench::runParties(opts, benchmark);
+}
@@ -13,7 +13,7 @@ double TimePoint::operator-(const TimePoint& rhs) const {
   return std::chrono::duration_cast<timeunit_t>(time - rhs.time).count();
 }
 
-CommPoint::CommPoint(io::NetIOMP& network) : stats(network.nP) {
+CommPoint::CommPoint(io::NetIOMP& network) : stats(network.nP), breakdown(network.accounting.counts()) {
   for (size_t i = 0; i < (size_t)network.nP; ++i) {
     if (i != (size_t)network.party) {
       stats[i] = network.get(i, false)->counter + network.get(i, true)->counter;
@@ -29,11 +29,34 @@ std::vector<uint64_t> CommPoint::operator-(const CommPoint& rhs) const {
   return res;
 }
 
+nlohmann::json CommPoint::breakdownSince(const CommPoint& rhs) const {
+  auto res = nlohmann::json::array();
+  for (const auto& [tag, count] : breakdown) {
+    io::CommCount before;
+    auto it = rhs.breakdown.find(tag);
+    if (it != rhs.breakdown.end()) {
+      before = it->second;
+    }
+    uint64_t bytes = count.bytes - before.bytes;
+    uint64_t rounds = count.rounds - before.rounds;
+    if (bytes == 0 && rounds == 0) {
+      continue;
+    }
+    res.push_back({{"phase", tag.phase},
+                   {"level", tag.level},
+                   {"gate", tag.gate},
+                   {"bytes", bytes},
+                   {"rounds", rounds}});
+  }
+  return res;
+}
+
 StatsPoint::StatsPoint(io::NetIOMP& network) : cpoint_(network) {}
 
 nlohmann::json StatsPoint::operator-(const StatsPoint& rhs) {
   return {{"time", tpoint_ - rhs.tpoint_},
-          {"communication", cpoint_ - rhs.cpoint_}};
+          {"communication", cpoint_ - rhs.cpoint_},
+          {"breakdown", cpoint_.breakdownSince(rhs.cpoint_)}};
 }
 
 bool saveJson(const nlohmann::json& data, const std::string& fpath) {
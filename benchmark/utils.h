@@ -4,6 +4,7 @@
 
 #include <array>
 #include <chrono>
+#include <map>
 #include <nlohmann/json.hpp>
 #include <string>
 
@@ -19,9 +20,14 @@ struct TimePoint {
 
 struct CommPoint {
   std::vector<uint64_t> stats;
+  // Bytes sent and round trips per phase, level and gate type
+  std::map<io::CommTag, io::CommCount> breakdown;
 
   explicit CommPoint(io::NetIOMP& network);
   std::vector<uint64_t> operator-(const CommPoint& rhs) const;
+  // Tags with communication in between, as a list of objects with the keys
+  // phase, level, gate, bytes and rounds
+  nlohmann::json breakdownSince(const CommPoint& rhs) const;
 };
 
 class StatsPoint {
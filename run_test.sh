@@ -135,6 +135,68 @@ elif [ $1 = 26 ]; then
     ./pi_1_ref_benchmark --localhost --depth 2 --nodes 10 --layers 3 --pid 0 > /dev/null &
     ./pi_1_ref_benchmark --localhost --depth 2 --nodes 10 --layers 3 --pid 2 > /dev/null &
     ./pi_1_ref_benchmark --localhost --depth 2 --nodes 10 --layers 3 --pid 1
+elif [ $1 = 27 ]; then
+    set -o xtrace
+    ./pi_3_test --localhost --lazy-preproc --pid 0 > /dev/null &
+    ./pi_3_test --localhost --lazy-preproc --pid 2 > /dev/null &
+    ./pi_3_test --localhost --lazy-preproc --pid 1
+elif [ $1 = 28 ]; then
+    set -o xtrace
+    ./pi_1_test --localhost --lazy-preproc --pid 0 > /dev/null &
+    ./pi_1_test --localhost --lazy-preproc --pid 2 > /dev/null &
+    ./pi_1_test --localhost --lazy-preproc --pid 1
+elif [ $1 = 29 ]; then
+    set -o xtrace
+    ./pi_3_test --localhost --preproc-mode offline --pid 0 > /dev/null &
+    ./pi_3_test --localhost --preproc-mode offline --pid 2 > /dev/null &
+    ./pi_3_test --localhost --preproc-mode offline --pid 1
+    wait
+    ./pi_3_test --localhost --preproc-mode online --pid 0 > /dev/null &
+    ./pi_3_test --localhost --preproc-mode online --pid 2 > /dev/null &
+    ./pi_3_test --localhost --preproc-mode online --pid 1
+elif [ $1 = 30 ]; then
+    set -o xtrace
+    ./pi_1_test --localhost --preproc-mode concurrent --preproc-queue 2 --pid 0 > /dev/null &
+    ./pi_1_test --localhost --preproc-mode concurrent --preproc-queue 2 --pid 2 > /dev/null &
+    ./pi_1_test --localhost --preproc-mode concurrent --preproc-queue 2 --pid 1
+elif [ $1 = 31 ]; then
+    set -o xtrace
+    ./pi_2_test --localhost --balanced-dealer --pid 0 > /dev/null &
+    ./pi_2_test --localhost --balanced-dealer --pid 2 > /dev/null &
+    ./pi_2_test --localhost --balanced-dealer --pid 1
+elif [ $1 = 32 ]; then
+    set -o xtrace
+    ./pi_1_benchmark --localhost --depth 2 --nodes 50 --size 200 --streams 3 --pid 0 > /dev/null &
+    ./pi_1_benchmark --localhost --depth 2 --nodes 50 --size 200 --streams 3 --pid 2 > /dev/null &
+    ./pi_1_benchmark --localhost --depth 2 --nodes 50 --size 200 --streams 3 --pid 1
+elif [ $1 = 33 ]; then
+    set -o xtrace
+    ./throughput --localhost --megabytes 16 --pid 0 > /dev/null &
+    ./throughput --localhost --megabytes 16 --pid 2 > /dev/null &
+    ./throughput --localhost --megabytes 16 --pid 1
+elif [ $1 = 34 ]; then
+    set -o xtrace
+    ./pi_1_benchmark --localhost --depth 2 --nodes 50 --size 200 --async-net --pid 0 > /dev/null &
+    ./pi_1_benchmark --localhost --depth 2 --nodes 50 --size 200 --async-net --pid 2 > /dev/null &
+    ./pi_1_benchmark --localhost --depth 2 --nodes 50 --size 200 --async-net --pid 1
+elif [ $1 = 35 ]; then
+    set -o xtrace
+    ./pi_2_test --localhost --transport tcp --pid 0 > /dev/null &
+    ./pi_2_test --localhost --transport tcp --pid 2 > /dev/null &
+    ./pi_2_test --localhost --transport tcp --pid 1
+elif [ $1 = 36 ]; then
+    set -o xtrace
+    ./pi_2_test --localhost --transport shm --pid 0 > /dev/null &
+    ./pi_2_test --localhost --transport shm --pid 2 > /dev/null &
+    ./pi_2_test --localhost --transport shm --pid 1
+elif [ $1 = 37 ]; then
+    set -o xtrace
+    ./pi_1_test --in-process
+elif [ $1 = 38 ]; then
+    set -o xtrace
+    ./pi_1_test --localhost --wan-latency 50 --wan-jitter 3 --wan-bandwidth 100 --pid 0 > /dev/null &
+    ./pi_1_test --localhost --wan-latency 50 --wan-jitter 3 --wan-bandwidth 100 --pid 2 > /dev/null &
+    ./pi_1_test --localhost --wan-latency 50 --wan-jitter 3 --wan-bandwidth 100 --pid 1
 else
     echo "unknown test case"
 fi
\ No newline at end of file
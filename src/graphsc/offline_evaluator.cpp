@@ -1,4 +1,6 @@
 #include "offline_evaluator.h"
+#include "preproc_expander.h"
+#include "preproc_pipeline.h"
 
 #include <algorithm>
 #include <cassert>
@@ -7,6 +9,19 @@
 
 const bool SHUFFLE_VERBOSE = false;
 
+static void printShufflePermutations(const std::vector<Ring>& pi_0, const std::vector<Ring>& pi_1,
+                                     const std::vector<Ring>& rho_0, const std::vector<Ring>& rho_1) {
+  const std::vector<Ring>* perms[4] = {&pi_0, &pi_1, &rho_0, &rho_1};
+  const char* names[4] = {"pi_0", "pi_1", "pi'_0", "pi'_1"};
+  for (int i = 0; i < 4; i++) {
+    std::cout << names[i] << std::endl;
+    for (auto v : *perms[i]) {
+      std::cout << v << " ";
+    }
+    std::cout << std::endl;
+  }
+}
+
 namespace graphsc {
 OfflineEvaluator::OfflineEvaluator(int my_id,
                                    std::shared_ptr<io::NetIOMP> network,
@@ -15,8 +30,7 @@ OfflineEvaluator::OfflineEvaluator(int my_id,
     : id_(my_id),
       rgen_(my_id, 3, seeds_h, seeds_l), 
       network_(std::move(network)),
-      circ_(std::move(circ)),
-      preproc_(circ.num_gates)
+      circ_(std::move(circ))
 
       {
         tpool_ = std::make_shared<ThreadPool>(threads);
@@ -128,93 +142,178 @@ void OfflineEvaluator::randomShareSecretBin( int pid,
 }
 
 
-void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils::wire_t, int>& input_pid_map, 
+void OfflineEvaluator::randomShareSecretTo1( int pid,
+                                          RandGenPool& rgen,
+                                          AddShare<Ring>& share,
+                                          Ring secret,
+                                          std::vector<Ring>& rand_sh_sec_to_1,
+                                          size_t& idx_rand_sh_sec_to_1) {
+  Ring val1;
+  Ring val2;
+
+  if(pid == 0) {
+    rgen.p02().random_data(&val2, sizeof(Ring));
+    val1 = secret - val2;
+    share.pushValue(secret);
+    rand_sh_sec_to_1.push_back(val1);
+  }
+  else if(pid == 1) {
+    val1 = rand_sh_sec_to_1[idx_rand_sh_sec_to_1];
+    idx_rand_sh_sec_to_1++;
+    share.pushValue(val1);
+  }
+  else{
+    rgen.p02().random_data(&val2, sizeof(Ring));
+    share.pushValue(val2);
+  }
+}
+
+void OfflineEvaluator::randomShareSecretBinTo1( int pid,
+                                          RandGenPool& rgen,
+                                          AddShare<Ring>& share,
+                                          Ring secret,
+                                          std::vector<Ring>& rand_sh_sec_to_1,
+                                          size_t& idx_rand_sh_sec_to_1) {
+  Ring val1;
+  Ring val2;
+
+  if(pid == 0) {
+    rgen.p02().random_data(&val2, sizeof(Ring));
+    val1 = secret ^ val2;
+    share.pushValue(secret);
+    rand_sh_sec_to_1.push_back(val1);
+  }
+  else if(pid == 1) {
+    val1 = rand_sh_sec_to_1[idx_rand_sh_sec_to_1];
+    idx_rand_sh_sec_to_1++;
+    share.pushValue(val1);
+  }
+  else{
+    rgen.p02().random_data(&val2, sizeof(Ring));
+    share.pushValue(val2);
+  }
+}
+
+
+void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils::wire_t, int>& input_pid_map,
                     std::vector<Ring>& rand_sh_sec, std::vector<Ring>& rand_sh_sec_to_1, std::vector<BoolRing>& b_rand_sh_sec,
                     std::vector<Ring>& rand_sh_party, std::vector<BoolRing>& b_rand_sh_party) {
 
-      size_t idx_rand_sh_sec = 0;
-      size_t idx_rand_sh_sec_to_1 = 0;
-      size_t b_idx_rand_sh_sec = 0;
-    
-      size_t idx_rand_sh_party = 0;
-      size_t b_idx_rand_sh_party = 0;
+    for (size_t depth = 0; depth < circ_.gates_by_level.size(); depth++) {
+      setWireMasksLevel(depth, rand_sh_sec, rand_sh_sec_to_1);
+    }
+}
+
+void OfflineEvaluator::setWireMasksLevel(size_t depth, std::vector<Ring>& rand_sh_sec, std::vector<Ring>& rand_sh_sec_to_1) {
 
+    size_t idx_rand_sh_sec = 0;
+    size_t idx_rand_sh_sec_to_1 = 0;
+    // Position of the next triple in this level, decides which party receives c
+    size_t num_triples = 0;
+    const auto& level = circ_.gates_by_level[depth];
+    // Masks of the input wires of dot products in this level, see PreprocCircuit::dotprod_pool
+    std::unordered_map<common::utils::wire_t, Ring> dotprod_masks;
+
+    // Material shared with P1/P2 is drawn from per-level streams, so that the
+    // online parties can regenerate it from the level seeds (see PreprocExpander).
+    emp::block seed_01, seed_02;
+    rgen_.p01().random_data(&seed_01, sizeof(emp::block));
+    rgen_.p02().random_data(&seed_02, sizeof(emp::block));
+    RandGenPool level_rgen(id_, seed_01, seed_02);
 
-    for (const auto& level : circ_.gates_by_level) {
     for (const auto& gate : level) {
+      size_t num_to_2 = rand_sh_sec.size();
+      size_t num_to_1 = rand_sh_sec_to_1.size();
+
       switch (gate->type) {
 
         case common::utils::GateType::kMul:
         case common::utils::GateType::kConvertB2A: {
-          preproc_.gates[gate->gid] = std::make_unique<PreprocMultGate<Ring>>();
-          
-
           AddShare<Ring> triple_a;
           AddShare<Ring> triple_b;
           AddShare<Ring> triple_c;
-          randomShare(id_, rgen_, triple_a);
-          randomShare(id_, rgen_, triple_b);
-          
+          randomShare(id_, level_rgen, triple_a);
+          randomShare(id_, level_rgen, triple_b);
+
           Ring c =  triple_a.valueAt()*triple_b.valueAt();
-          
 
- 
-          randomShareSecret(id_, rgen_, *network_, triple_c, c, rand_sh_sec, idx_rand_sh_sec);
 
-          if (id_ != 0)
-            preproc_.gates[gate->gid] = std::move(std::make_unique<PreprocMultGate<Ring>>
-                              (triple_a, triple_b, triple_c));
-          
+
+          if (tripleReceiver(balanced_dealer_, num_triples++) == 2)
+            randomShareSecret(id_, level_rgen, *network_, triple_c, c, rand_sh_sec, idx_rand_sh_sec);
+          else
+            randomShareSecretTo1(id_, level_rgen, triple_c, c, rand_sh_sec_to_1, idx_rand_sh_sec_to_1);
+
           break;
         }
 
         case common::utils::GateType::kAnd:
         case common::utils::GateType::kEqualsZero: {
-          preproc_.gates[gate->gid] = std::make_unique<PreprocMultGate<Ring>>();
-          
-
           AddShare<Ring> triple_a;
           AddShare<Ring> triple_b;
           AddShare<Ring> triple_c;
-          randomShareBin(id_, rgen_, triple_a);
-          randomShareBin(id_, rgen_, triple_b);
-          
+          randomShareBin(id_, level_rgen, triple_a);
+          randomShareBin(id_, level_rgen, triple_b);
+
           Ring c =  triple_a.valueAt() & triple_b.valueAt();
-          
 
- 
-          randomShareSecretBin(id_, rgen_, *network_, triple_c, c, rand_sh_sec, idx_rand_sh_sec);
 
-          if (id_ != 0)
-            preproc_.gates[gate->gid] = std::move(std::make_unique<PreprocMultGate<Ring>>
-                              (triple_a, triple_b, triple_c));
-          
+
+          if (tripleReceiver(balanced_dealer_, num_triples++) == 2)
+            randomShareSecretBin(id_, level_rgen, *network_, triple_c, c, rand_sh_sec, idx_rand_sh_sec);
+          else
+            randomShareSecretBinTo1(id_, level_rgen, triple_c, c, rand_sh_sec_to_1, idx_rand_sh_sec_to_1);
+
           break;
         }
 
         case common::utils::GateType::kGenCompaction: {
           auto *g = static_cast<common::utils::SIMDOGate *>(gate.get());
-          preproc_.gates[gate->gid] = std::make_unique<PreprocGenCompactionGate<Ring>>();
-          
-
           std::vector<AddShare<Ring>> triple_a;
           std::vector<AddShare<Ring>> triple_b;
           std::vector<AddShare<Ring>> triple_c;
           for (int j = 0; j < g->in1.size(); j++) {
             triple_a.push_back(AddShare<Ring>());
             triple_b.push_back(AddShare<Ring>());
-            randomShare(id_, rgen_, triple_a[j]);
-            randomShare(id_, rgen_, triple_b[j]);
+            randomShare(id_, level_rgen, triple_a[j]);
+            randomShare(id_, level_rgen, triple_b[j]);
 
             triple_c.push_back(AddShare<Ring>());
             Ring c = triple_a[j].valueAt() * triple_b[j].valueAt();
-            randomShareSecret(id_, rgen_, *network_, triple_c[j], c, rand_sh_sec, idx_rand_sh_sec);
+            if (tripleReceiver(balanced_dealer_, num_triples++) == 2)
+              randomShareSecret(id_, level_rgen, *network_, triple_c[j], c, rand_sh_sec, idx_rand_sh_sec);
+            else
+              randomShareSecretTo1(id_, level_rgen, triple_c[j], c, rand_sh_sec_to_1, idx_rand_sh_sec_to_1);
           }
 
-          if (id_ != 0)
-            preproc_.gates[gate->gid] = std::move(std::make_unique<PreprocGenCompactionGate<Ring>>
-                              (triple_a, triple_b, triple_c));
-          
+          break;
+        }
+
+        case common::utils::GateType::kDotprod: {
+          auto *g = static_cast<common::utils::SIMDGate *>(gate.get());
+          // Every input is opened once per level, so only c depends on the gate
+          Ring c = 0;
+          for (size_t j = 0; j < g->in1.size(); j++) {
+            Ring masks[2];
+            for (int k = 0; k < 2; k++) {
+              auto w = k == 0 ? g->in1[j] : g->in2[j];
+              auto it = dotprod_masks.find(w);
+              if (it == dotprod_masks.end()) {
+                AddShare<Ring> mask;
+                randomShare(id_, level_rgen, mask);
+                it = dotprod_masks.emplace(w, mask.valueAt()).first;
+              }
+              masks[k] = it->second;
+            }
+            c += masks[0] * masks[1];
+          }
+
+          AddShare<Ring> share_c;
+          if (tripleReceiver(balanced_dealer_, num_triples++) == 2)
+            randomShareSecret(id_, level_rgen, *network_, share_c, c, rand_sh_sec, idx_rand_sh_sec);
+          else
+            randomShareSecretTo1(id_, level_rgen, share_c, c, rand_sh_sec_to_1, idx_rand_sh_sec_to_1);
+
           break;
         }
 
@@ -225,13 +324,10 @@ void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils:
             std::cout << "Running in reverse mode" << std::endl;
           }
 
-          preproc_.gates[gate->gid] = std::make_unique<PreprocShuffleGate<Ring>>();
-
           bool newPerm;
           if (g->param < pis_0.size()) {
             if (pis_0[g->param]->size() == 0 && pis_1[g->param]->size() == 0) {
               // Was added as a dummy element
-              // need to check both as online parties only have one filled
               if (SHUFFLE_VERBOSE)
                 std::cout << "Generating new permutation (prior filler)" << std::endl;
               newPerm = true;
@@ -264,39 +360,20 @@ void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils:
           std::vector<Ring> b_0, b_1;
 
           if (newPerm) { // can skip this if old permutation is reused
-            // Generate pi_0, pi_1
-            for (int i = 0; i < 2; i++) {
-              if ((i == 0 && id_ == 2) || (i == 1 && id_ == 1))
-                continue;
-              auto& perm = i == 1 ? pi_1 : pi_0;
-              for (int j = 0; j < g->in1.size(); j++)
-                perm.push_back(j);
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::size_t k;
-                if (i == 0)
-                  rgen_.p01().random_data(&k, sizeof(std::size_t));
-                else
-                  rgen_.p02().random_data(&k, sizeof(std::size_t));
-                k = k % (g->in1.size() - j);
-                std::swap(perm[j], perm[k + j]);
-              }
-            }
-
-            // Generate pi'_0
-            if (id_ != 2) {
-              auto& perm = rho_0;
-              for (int j = 0; j < g->in1.size(); j++)
-                perm.push_back(j);
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::size_t k;
-                rgen_.p01().random_data(&k, sizeof(std::size_t));
-                k = k % (g->in1.size() - j);
-                std::swap(perm[j], perm[k + j]);
-              }
-            }
-
-            // Compute and send pi'_1 s.t. pi'_1 * pi'_0 = pi_0 * pi_1
-            if (id_ == 0) {
+            // Permutations get their own seeds as they may be reused in later levels
+            emp::block perm_seed_01, perm_seed_02;
+            rgen_.p01().random_data(&perm_seed_01, sizeof(emp::block));
+            rgen_.p02().random_data(&perm_seed_02, sizeof(emp::block));
+            emp::PRG perm_01(&perm_seed_01);
+            emp::PRG perm_02(&perm_seed_02);
+
+            if (shufflePermReceiver(balanced_dealer_, g->param) == 2) {
+              // Generate pi_0, pi_1 and pi'_0
+              randomPermutation(perm_01, g->in1.size(), pi_0);
+              randomPermutation(perm_02, g->in1.size(), pi_1);
+              randomPermutation(perm_01, g->in1.size(), rho_0);
+
+              // Compute and send pi'_1 s.t. pi'_1 * pi'_0 = pi_0 * pi_1
               // Compute pi'_0^(-1)
               std::vector<int> inverse(g->in1.size());
               for (int j = 0; j < g->in1.size(); j++) {
@@ -311,124 +388,70 @@ void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils:
               for (int j = 0; j < g->in1.size(); j++) {
                 rand_sh_sec.push_back((Ring) perm[j]);
               }
-            } else if (id_ == 2) { // Receive pi'_1
-              auto& perm = rho_1;
-              for (int j = 0; j < g->in1.size(); j++) {
-                perm.push_back(rand_sh_sec[idx_rand_sh_sec]);
-                idx_rand_sh_sec++;
-              }
-            }
-          }
-
-          if (SHUFFLE_VERBOSE) {
-            std::cout << "pi_0" << std::endl;
-            if (id_ == 2) {
-              std::cout << "not available" << std::endl;
-            } else {
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::cout << pi_0[j] << " ";
-              }
-              std::cout << std::endl;
-            }
-            std::cout << "pi_1" << std::endl;
-            if (id_ == 1) {
-              std::cout << "not available" << std::endl;
             } else {
+              // Balanced dealer: generate pi_0, pi_1 and pi'_1 instead
+              randomPermutation(perm_01, g->in1.size(), pi_0);
+              randomPermutation(perm_02, g->in1.size(), pi_1);
+              randomPermutation(perm_02, g->in1.size(), rho_1);
+
+              // Compute and send pi'_0 = pi'_1^(-1) * pi_0 * pi_1 to P1
+              std::vector<int> inverse(g->in1.size());
               for (int j = 0; j < g->in1.size(); j++) {
-                std::cout << pi_1[j] << " ";
+                inverse[rho_1[j]] = j;
               }
-              std::cout << std::endl;
-            }
-            std::cout << "pi'_0" << std::endl;
-            if (id_ == 2) {
-              std::cout << "not available" << std::endl;
-            } else {
               for (int j = 0; j < g->in1.size(); j++) {
-                std::cout << rho_0[j] << " ";
+                rho_0.push_back(inverse[pi_0[pi_1[j]]]);
               }
-              std::cout << std::endl;
-            }
-            std::cout << "pi'_1" << std::endl;
-            if (id_ == 1) {
-              std::cout << "not available" << std::endl;
-            } else {
+
               for (int j = 0; j < g->in1.size(); j++) {
-                std::cout << rho_1[j] << " ";
+                rand_sh_sec_to_1.push_back((Ring) rho_0[j]);
               }
-              std::cout << std::endl;
             }
           }
 
+          if (SHUFFLE_VERBOSE) {
+            printShufflePermutations(pi_0, pi_1, rho_0, rho_1);
+          }
+
           // Sample R_0, R_1
           std::vector<Ring> mask_0, mask_1;
-          if (id_ != 2) {
-            for (int j = 0; j < g->in1.size(); j++) {
-              Ring m;
-              rgen_.p01().random_data(&m, sizeof(Ring));
-              mask_0.push_back(m);
-            }
-          }
-          if (id_ != 1) {
-            for (int j = 0; j < g->in1.size(); j++) {
-              Ring m;
-              rgen_.p02().random_data(&m, sizeof(Ring));
-              mask_1.push_back(m);
-            }
-          }
+          randomRingElements(level_rgen.p01(), g->in1.size(), mask_0);
+          randomRingElements(level_rgen.p02(), g->in1.size(), mask_1);
 
           // Compute B_0, B_1
-          if (id_ == 0) {
-            b_0.resize(g->in1.size());
-            b_1.resize(g->in1.size());
-            for (size_t j = 0; j < g->in1.size(); j++) {
-              Ring randomizer;
-              rgen_.self().random_data(&randomizer, sizeof(Ring));
-              if (reverse) {
-                  // B_i = pi^(-1)(R_i) +/- R
-                  // pi^(-1) = (pi_0 * pi_1)^(-1) = (shuffle[0] * shuffle[2])^(-1)
-                  b_0[j] = mask_0[pi_0[pi_1[j]]] - randomizer;
-                  b_1[j] = mask_1[pi_0[pi_1[j]]] + randomizer;
-              } else {
-                  // B_i = pi(R_i) +/- R
-                  // pi = pi_0 * pi_1 = shuffle[0] * shuffle[2]
-                  b_0[pi_0[pi_1[j]]] = mask_0[j] - randomizer;
-                  b_1[pi_0[pi_1[j]]] = mask_1[j] + randomizer;
-              }
+          b_0.resize(g->in1.size());
+          b_1.resize(g->in1.size());
+          for (size_t j = 0; j < g->in1.size(); j++) {
+            Ring randomizer;
+            rgen_.self().random_data(&randomizer, sizeof(Ring));
+            if (reverse) {
+                // B_i = pi^(-1)(R_i) +/- R
+                // pi^(-1) = (pi_0 * pi_1)^(-1) = (shuffle[0] * shuffle[2])^(-1)
+                b_0[j] = mask_0[pi_0[pi_1[j]]] - randomizer;
+                b_1[j] = mask_1[pi_0[pi_1[j]]] + randomizer;
+            } else {
+                // B_i = pi(R_i) +/- R
+                // pi = pi_0 * pi_1 = shuffle[0] * shuffle[2]
+                b_0[pi_0[pi_1[j]]] = mask_0[j] - randomizer;
+                b_1[pi_0[pi_1[j]]] = mask_1[j] + randomizer;
             }
+          }
 
-            for (int j = 0; j < g->in1.size(); j++) {
-              rand_sh_sec_to_1.push_back(b_0[j]);
-              rand_sh_sec.push_back(b_1[j]);
-            }
-          } else if (id_ == 1) {
-            for (int j = 0; j < g->in1.size(); j++) {
-              b_0.push_back(rand_sh_sec_to_1[idx_rand_sh_sec_to_1]);
-              idx_rand_sh_sec_to_1++;
-            }
-          } else {
-            for (int j = 0; j < g->in1.size(); j++) {
-              b_1.push_back(rand_sh_sec[idx_rand_sh_sec]);
-              idx_rand_sh_sec++;
-            }
+          for (int j = 0; j < g->in1.size(); j++) {
+            rand_sh_sec_to_1.push_back(b_0[j]);
+            rand_sh_sec.push_back(b_1[j]);
           }
 
-          if (id_ != 0)
-            preproc_.gates[gate->gid] = std::move(std::make_unique<PreprocShuffleGate<Ring>>
-                              (pis_0[g->param], pis_1[g->param], rhos_0[g->param], rhos_1[g->param], b_0, b_1, mask_0, mask_1));
-          
           break;
         }
 
         case common::utils::GateType::kDoubleShuffle: {
           auto *g = static_cast<common::utils::ThreeParamSIMDOGate *>(gate.get());
 
-          preproc_.gates[gate->gid] = std::make_unique<PreprocShuffleGate<Ring>>(); // can use standard and just set permutations differently
-
           bool newPerm;
           if (g->param1 < pis_0.size()) {
             if (pis_0[g->param1]->size() == 0 && pis_1[g->param1]->size() == 0) {
               // Was added as a dummy element
-              // need to check both as online parties only have one filled
               if (SHUFFLE_VERBOSE)
                 std::cout << "Generating new permutation (prior filler)" << std::endl;
               newPerm = true;
@@ -454,13 +477,13 @@ void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils:
           }
 
           if (newPerm) {
-            if (g->param2 >= pis_0.size() || g->param3 >= pis_0.size() || 
+            if (g->param2 >= pis_0.size() || g->param3 >= pis_0.size() ||
                   (pis_0[g->param2]->size() == 0 && pis_1[g->param2]->size() == 0) ||
                   (pis_0[g->param3]->size() == 0 && pis_1[g->param3]->size() == 0)) {
               throw std::runtime_error("DoubleShuffle can only be prepared AFTER both underlying shuffles have been prepared in the layered circuit");
             }
           }
-          
+
 
           std::vector<Ring>& pi_0 = *pis_0[g->param1];
           std::vector<Ring>& pi_1 = *pis_1[g->param1];
@@ -470,29 +493,17 @@ void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils:
           std::vector<Ring> b_0, b_1;
 
           if (newPerm) { // can skip this if old permutation is reused
+            emp::block perm_seed_01, perm_seed_02;
+            rgen_.p01().random_data(&perm_seed_01, sizeof(emp::block));
+            rgen_.p02().random_data(&perm_seed_02, sizeof(emp::block));
+            emp::PRG perm_01(&perm_seed_01);
+            emp::PRG perm_02(&perm_seed_02);
+
             // Generate pi_0
-            if (id_ != 2) {
-              for (int j = 0; j < g->in1.size(); j++)
-                pi_0.push_back(j);
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::size_t k;
-                rgen_.p01().random_data(&k, sizeof(std::size_t));
-                k = k % (g->in1.size() - j);
-                std::swap(pi_0[j], pi_0[k + j]);
-              }
-            }
+            randomPermutation(perm_01, g->in1.size(), pi_0);
 
             // Generate rho_1 // load balancing
-            if (id_ != 1) {
-              for (int j = 0; j < g->in1.size(); j++)
-                rho_1.push_back(j);
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::size_t k;
-                rgen_.p02().random_data(&k, sizeof(std::size_t));
-                k = k % (g->in1.size() - j);
-                std::swap(rho_1[j], rho_1[k + j]);
-              }
-            }
+            randomPermutation(perm_02, g->in1.size(), rho_1);
 
             // There are two underlying permutations: pi2_0 * pi2_1 = rho2_1 * rho2_0
             // and pi3_0 * pi3_1 = rho3_1 * rho3_0, specified by param2 and param3.
@@ -502,159 +513,225 @@ void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils:
             // pi_1 = pi_0^(-1) * pi3_0 * pi3_1 * pi2_1^(-1) * pi2_0^(-1)
             // rho_0 = rho_1^(-1) * pi_0 * pi_1
 
-            if (id_ == 0) {
-              std::vector<Ring>& pi2_0 = *pis_0[g->param2];
-              std::vector<Ring>& pi2_1 = *pis_1[g->param2];
-              std::vector<Ring>& pi3_0 = *pis_0[g->param3];
-              std::vector<Ring>& pi3_1 = *pis_1[g->param3];
+            std::vector<Ring>& pi2_0 = *pis_0[g->param2];
+            std::vector<Ring>& pi2_1 = *pis_1[g->param2];
+            std::vector<Ring>& pi3_0 = *pis_0[g->param3];
+            std::vector<Ring>& pi3_1 = *pis_1[g->param3];
 
-              // pi_1 = pi_0^(-1) * pi3_0 * pi3_1 * pi2_1^(-1) * pi2_0^(-1) = pi_0^(-1) * pi3_0 * pi3_1 * (pi2_0 * pi2_1)^(-1)
-              // Compute pi_0^(-1)
-              std::vector<int> pi_0_inv(g->in1.size());
-              for (int j = 0; j < g->in1.size(); j++) {
-                pi_0_inv[pi_0[j]] = j;
-              }
-              // Compute (pi2_0 * pi2_1)^(-1)
-              std::vector<int> pi2_comp_inv(g->in1.size());
-              for (int j = 0; j < g->in1.size(); j++) {
-                pi2_comp_inv[pi2_0[pi2_1[j]]] = j;
-              }
-              // Compose all
-              for (int j = 0; j < g->in1.size(); j++) {
-                pi_1.push_back(pi_0_inv[pi3_0[pi3_1[pi2_comp_inv[j]]]]);
-              }
-              for (int j = 0; j < g->in1.size(); j++) {
-                rand_sh_sec.push_back((Ring) pi_1[j]);
-              }
-
-              // rho_0 = rho_1^(-1) * pi_0 * pi_1
-              // Compute rho_1^(-1)
-              std::vector<int> rho_1_inv(g->in1.size());
-              for (int j = 0; j < g->in1.size(); j++) {
-                rho_1_inv[rho_1[j]] = j;
-              }
-              // Compose all
-              for (int j = 0; j < g->in1.size(); j++) {
-                rho_0.push_back(rho_1_inv[pi_0[pi_1[j]]]);
-              }
-              for (int j = 0; j < g->in1.size(); j++) {
-                rand_sh_sec_to_1.push_back((Ring) rho_0[j]);
-              }
-            } else if (id_ == 1) { // Receive rho_0
-              for (int j = 0; j < g->in1.size(); j++) {
-                rho_0.push_back(rand_sh_sec_to_1[idx_rand_sh_sec_to_1]);
-                idx_rand_sh_sec_to_1++;
-              }
-            } else { // Receive pi_1
-              for (int j = 0; j < g->in1.size(); j++) {
-                pi_1.push_back(rand_sh_sec[idx_rand_sh_sec]);
-                idx_rand_sh_sec++;
-              }
-            }
-          }
-
-          // TODO cleanup as from here, practically only duplicate code from standard shuffle
-          if (SHUFFLE_VERBOSE) {
-            std::cout << "pi_0" << std::endl;
-            if (id_ == 2) {
-              std::cout << "not available" << std::endl;
-            } else {
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::cout << pi_0[j] << " ";
-              }
-              std::cout << std::endl;
+            // pi_1 = pi_0^(-1) * pi3_0 * pi3_1 * pi2_1^(-1) * pi2_0^(-1) = pi_0^(-1) * pi3_0 * pi3_1 * (pi2_0 * pi2_1)^(-1)
+            // Compute pi_0^(-1)
+            std::vector<int> pi_0_inv(g->in1.size());
+            for (int j = 0; j < g->in1.size(); j++) {
+              pi_0_inv[pi_0[j]] = j;
             }
-            std::cout << "pi_1" << std::endl;
-            if (id_ == 1) {
-              std::cout << "not available" << std::endl;
-            } else {
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::cout << pi_1[j] << " ";
-              }
-              std::cout << std::endl;
+            // Compute (pi2_0 * pi2_1)^(-1)
+            std::vector<int> pi2_comp_inv(g->in1.size());
+            for (int j = 0; j < g->in1.size(); j++) {
+              pi2_comp_inv[pi2_0[pi2_1[j]]] = j;
             }
-            std::cout << "pi'_0" << std::endl;
-            if (id_ == 2) {
-              std::cout << "not available" << std::endl;
-            } else {
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::cout << rho_0[j] << " ";
-              }
-              std::cout << std::endl;
+            // Compose all
+            for (int j = 0; j < g->in1.size(); j++) {
+              pi_1.push_back(pi_0_inv[pi3_0[pi3_1[pi2_comp_inv[j]]]]);
             }
-            std::cout << "pi'_1" << std::endl;
-            if (id_ == 1) {
-              std::cout << "not available" << std::endl;
-            } else {
-              for (int j = 0; j < g->in1.size(); j++) {
-                std::cout << rho_1[j] << " ";
-              }
-              std::cout << std::endl;
+            for (int j = 0; j < g->in1.size(); j++) {
+              rand_sh_sec.push_back((Ring) pi_1[j]);
             }
-          }
 
-          // Sample R_0, R_1
-          std::vector<Ring> mask_0, mask_1;
-          if (id_ != 2) {
+            // rho_0 = rho_1^(-1) * pi_0 * pi_1
+            // Compute rho_1^(-1)
+            std::vector<int> rho_1_inv(g->in1.size());
             for (int j = 0; j < g->in1.size(); j++) {
-              Ring m;
-              rgen_.p01().random_data(&m, sizeof(Ring));
-              mask_0.push_back(m);
+              rho_1_inv[rho_1[j]] = j;
             }
-          }
-          if (id_ != 1) {
+            // Compose all
             for (int j = 0; j < g->in1.size(); j++) {
-              Ring m;
-              rgen_.p02().random_data(&m, sizeof(Ring));
-              mask_1.push_back(m);
+              rho_0.push_back(rho_1_inv[pi_0[pi_1[j]]]);
+            }
+            for (int j = 0; j < g->in1.size(); j++) {
+              rand_sh_sec_to_1.push_back((Ring) rho_0[j]);
             }
           }
 
+          if (SHUFFLE_VERBOSE) {
+            printShufflePermutations(pi_0, pi_1, rho_0, rho_1);
+          }
+
+          // Sample R_0, R_1
+          std::vector<Ring> mask_0, mask_1;
+          randomRingElements(level_rgen.p01(), g->in1.size(), mask_0);
+          randomRingElements(level_rgen.p02(), g->in1.size(), mask_1);
+
           // Compute B_0, B_1
-          if (id_ == 0) {
-            b_0.resize(g->in1.size());
-            b_1.resize(g->in1.size());
-            for (size_t j = 0; j < g->in1.size(); j++) {
-              Ring randomizer;
-              rgen_.self().random_data(&randomizer, sizeof(Ring));
-              // B_i = pi(R_i) +/- R
-              // pi = pi_0 * pi_1 = shuffle[0] * shuffle[2]
-              b_0[pi_0[pi_1[j]]] = mask_0[j] - randomizer;
-              b_1[pi_0[pi_1[j]]] = mask_1[j] + randomizer;
-            }
+          b_0.resize(g->in1.size());
+          b_1.resize(g->in1.size());
+          for (size_t j = 0; j < g->in1.size(); j++) {
+            Ring randomizer;
+            rgen_.self().random_data(&randomizer, sizeof(Ring));
+            // B_i = pi(R_i) +/- R
+            // pi = pi_0 * pi_1 = shuffle[0] * shuffle[2]
+            b_0[pi_0[pi_1[j]]] = mask_0[j] - randomizer;
+            b_1[pi_0[pi_1[j]]] = mask_1[j] + randomizer;
+          }
 
-            for (int j = 0; j < g->in1.size(); j++) {
-              rand_sh_sec_to_1.push_back(b_0[j]);
-              rand_sh_sec.push_back(b_1[j]);
-            }
-          } else if (id_ == 1) {
-            for (int j = 0; j < g->in1.size(); j++) {
-              b_0.push_back(rand_sh_sec_to_1[idx_rand_sh_sec_to_1]);
-              idx_rand_sh_sec_to_1++;
+          for (int j = 0; j < g->in1.size(); j++) {
+            rand_sh_sec_to_1.push_back(b_0[j]);
+            rand_sh_sec.push_back(b_1[j]);
+          }
+
+          break;
+        }
+
+        default: {
+          break;
+        }
+      }
+
+      io::CommTag tag{"offline", static_cast<int64_t>(depth), common::utils::toString(gate->type)};
+      addShare(shares_to_2_, tag, sizeof(Ring) * (rand_sh_sec.size() - num_to_2));
+      addShare(shares_to_1_, tag, sizeof(Ring) * (rand_sh_sec_to_1.size() - num_to_1));
+    }
+}
+
+void OfflineEvaluator::addShare(std::vector<io::CommShare>& shares, const io::CommTag& tag, uint64_t bytes) {
+    if (bytes == 0) {
+      return;
+    }
+    if (!shares.empty() && !(shares.back().tag < tag) && !(tag < shares.back().tag)) {
+      shares.back().bytes += bytes;
+    } else {
+      shares.push_back({tag, bytes});
+    }
+}
+
+
+void OfflineEvaluator::drawSeedsParty(const std::unordered_map<common::utils::wire_t, int>& input_pid_map) {
+
+    // Same order as the dealer: the seed of a level, then the seeds of the
+    // permutations used for the first time in that level.
+    emp::PRG& prg_dealer = id_ == 1 ? rgen_.p01() : rgen_.p02();
+    std::vector<bool> perm_ready;
+
+    preproc_.level_seeds.resize(circ_.gates_by_level.size());
+    preproc_.level_corrections.resize(circ_.gates_by_level.size());
+
+    for (size_t depth = 0; depth < circ_.gates_by_level.size(); depth++) {
+    prg_dealer.random_data(&preproc_.level_seeds[depth], sizeof(emp::block));
+
+    for (const auto& gate : circ_.gates_by_level[depth]) {
+      switch (gate->type) {
+
+        case common::utils::GateType::kShuffle:
+        case common::utils::GateType::kDoubleShuffle: {
+          size_t param;
+          if (gate->type == common::utils::GateType::kDoubleShuffle) {
+            auto *g = static_cast<common::utils::ThreeParamSIMDOGate *>(gate.get());
+            param = g->param1;
+            if (!(param < perm_ready.size() && perm_ready[param]) &&
+                  (g->param2 >= perm_ready.size() || g->param3 >= perm_ready.size() ||
+                  !perm_ready[g->param2] || !perm_ready[g->param3])) {
+              throw std::runtime_error("DoubleShuffle can only be prepared AFTER both underlying shuffles have been prepared in the layered circuit");
             }
           } else {
-            for (int j = 0; j < g->in1.size(); j++) {
-              b_1.push_back(rand_sh_sec[idx_rand_sh_sec]);
-              idx_rand_sh_sec++;
-            }
+            param = static_cast<common::utils::ParamWithFlagSIMDOGate *>(gate.get())->param;
           }
 
-          if (id_ != 0)
-            preproc_.gates[gate->gid] = std::move(std::make_unique<PreprocShuffleGate<Ring>>
-                              (pis_0[g->param1], pis_1[g->param1], rhos_0[g->param1], rhos_1[g->param1], b_0, b_1, mask_0, mask_1));
-          
+          if (param >= perm_ready.size()) {
+            perm_ready.resize(param + 1, false);
+            preproc_.perm_seeds.resize(param + 1);
+            preproc_.perm_corrections.resize(param + 1);
+          }
+          if (!perm_ready[param]) {
+            perm_ready[param] = true;
+            prg_dealer.random_data(&preproc_.perm_seeds[param], sizeof(emp::block));
+            preproc_.perm_corrections[param] = std::make_shared<std::vector<Ring>>();
+          }
           break;
         }
 
-        case common::utils::GateType::kInp: {
-          preproc_.gates[gate->gid] = std::move(std::make_unique<PreprocInput<Ring>>
-                              (input_pid_map.at(gate->out)));
+        case common::utils::GateType::kInp:
+        case common::utils::GateType::kBinInp: {
+          preproc_.input_pids.push_back(input_pid_map.at(gate->out));
           break;
         }
 
-        case common::utils::GateType::kBinInp: {
-          preproc_.gates[gate->gid] = std::move(std::make_unique<PreprocInput<Ring>>
-                              (input_pid_map.at(gate->out)));
+        default: {
+          break;
+        }
+      }
+    }
+  }
+}
+
+
+size_t OfflineEvaluator::takeLevelCorrections(int id, const common::utils::LevelOrderedCircuit& circ, size_t depth,
+                    const Ring* from_dealer, std::vector<bool>& perm_ready, PreprocCircuit<Ring>& preproc) {
+
+    size_t idx = 0;
+    size_t num_triples = 0;
+    std::vector<Ring> corrections;
+
+    for (const auto& gate : circ.gates_by_level[depth]) {
+      switch (gate->type) {
+
+        case common::utils::GateType::kMul:
+        case common::utils::GateType::kConvertB2A:
+        case common::utils::GateType::kAnd:
+        case common::utils::GateType::kEqualsZero:
+        case common::utils::GateType::kDotprod: {
+          // One party receives its share of c, the other one derives it
+          if (tripleReceiver(preproc.balanced_dealer, num_triples++) == id) {
+            if (from_dealer != nullptr)
+              corrections.push_back(from_dealer[idx]);
+            idx++;
+          }
+          break;
+        }
+
+        case common::utils::GateType::kGenCompaction: {
+          auto *g = static_cast<common::utils::SIMDOGate *>(gate.get());
+          for (size_t j = 0; j < g->in1.size(); j++) {
+            if (tripleReceiver(preproc.balanced_dealer, num_triples++) == id) {
+              if (from_dealer != nullptr)
+                corrections.push_back(from_dealer[idx]);
+              idx++;
+            }
+          }
+          break;
+        }
+
+        case common::utils::GateType::kShuffle:
+        case common::utils::GateType::kDoubleShuffle: {
+          bool double_shuffle = gate->type == common::utils::GateType::kDoubleShuffle;
+          size_t param;
+          size_t n;
+          if (double_shuffle) {
+            auto *g = static_cast<common::utils::ThreeParamSIMDOGate *>(gate.get());
+            param = g->param1;
+            n = g->in1.size();
+          } else {
+            auto *g = static_cast<common::utils::ParamWithFlagSIMDOGate *>(gate.get());
+            param = g->param;
+            n = g->in1.size();
+          }
+
+          if (param >= perm_ready.size()) {
+            perm_ready.resize(param + 1, false);
+          }
+          if (!perm_ready[param]) {
+            perm_ready[param] = true;
+            // For a shuffle, P2 receives pi'_1 (or P1 pi'_0, see shufflePermReceiver).
+            // For a double shuffle, P1 receives pi'_0 and P2 receives pi_1.
+            if (double_shuffle || shufflePermReceiver(preproc.balanced_dealer, param) == id) {
+              if (from_dealer != nullptr)
+                preproc.perm_corrections[param]->assign(from_dealer + idx, from_dealer + idx + n);
+              idx += n;
+            }
+          }
+
+          // B_0 for P1, B_1 for P2
+          if (from_dealer != nullptr)
+            corrections.insert(corrections.end(), from_dealer + idx, from_dealer + idx + n);
+          idx += n;
           break;
         }
 
@@ -663,12 +740,102 @@ void OfflineEvaluator::setWireMasksParty(const std::unordered_map<common::utils:
         }
       }
     }
+
+    if (from_dealer != nullptr)
+      preproc.level_corrections[depth] = std::move(corrections);
+    return idx;
+}
+
+
+void OfflineEvaluator::setWireSeedsParty(const std::unordered_map<common::utils::wire_t, int>& input_pid_map,
+                    std::vector<Ring>& rand_sh_sec, std::vector<Ring>& rand_sh_sec_to_1) {
+
+    drawSeedsParty(input_pid_map);
+
+    // Values P0 sent to this party, in the order in which they were generated.
+    std::vector<Ring>& from_dealer = id_ == 1 ? rand_sh_sec_to_1 : rand_sh_sec;
+    std::vector<bool> perm_ready;
+    size_t num_corrections = 0;
+    for (size_t depth = 0; depth < circ_.gates_by_level.size(); depth++) {
+      num_corrections += takeLevelCorrections(id_, circ_, depth, nullptr, perm_ready, preproc_);
+    }
+    if (num_corrections != from_dealer.size()) {
+      throw std::runtime_error("Received preprocessing does not match the circuit");
+    }
+
+    perm_ready.clear();
+    size_t idx = 0;
+    for (size_t depth = 0; depth < circ_.gates_by_level.size(); depth++) {
+      idx += takeLevelCorrections(id_, circ_, depth, from_dealer.data() + idx, perm_ready, preproc_);
+    }
+    from_dealer = std::vector<Ring>();
+    preproc_.compressed = true;
+
+    if (!lazy_expansion_) {
+      PreprocExpander(id_).expandAll(circ_, preproc_);
+    }
+}
+
+
+void OfflineEvaluator::setWireMasksPipelined(
+    const std::unordered_map<common::utils::wire_t, int>& input_pid_map) {
+
+  // All parties know from the circuit how many values P0 sends per level
+  std::vector<bool> perm_ready_1, perm_ready_2;
+  size_t num_to_1 = 0;
+  size_t num_to_2 = 0;
+  for (size_t depth = 0; depth < circ_.gates_by_level.size(); depth++) {
+    num_to_1 += takeLevelCorrections(1, circ_, depth, nullptr, perm_ready_1, preproc_);
+    num_to_2 += takeLevelCorrections(2, circ_, depth, nullptr, perm_ready_2, preproc_);
+  }
+
+  if (id_ == 0) {
+    // Same header as without pipelining
+    network_->accounting.setTag({"offline", -1, "Header"});
+    std::vector<size_t> lengths = {num_to_2, num_to_2, 0, 0, 0, 0};
+    network_->send(2, lengths.data(), sizeof(size_t) * 6);
+    network_->send(1, &num_to_1, sizeof(size_t));
+
+    std::vector<Ring> rand_sh_sec, rand_sh_sec_to_1;
+    for (size_t depth = 0; depth < circ_.gates_by_level.size(); depth++) {
+      setWireMasksLevel(depth, rand_sh_sec, rand_sh_sec_to_1);
+      // sendBulk flushes every level, so that P1 and P2 can start on it right away
+      network_->accounting.setShares({"offline", static_cast<int64_t>(depth), ""}, std::move(shares_to_2_));
+      network_->sendBulk(2, rand_sh_sec.data(), sizeof(Ring) * rand_sh_sec.size());
+      network_->accounting.setShares({"offline", static_cast<int64_t>(depth), ""}, std::move(shares_to_1_));
+      network_->sendBulk(1, rand_sh_sec_to_1.data(), sizeof(Ring) * rand_sh_sec_to_1.size());
+      rand_sh_sec.clear();
+      rand_sh_sec_to_1.clear();
+      shares_to_2_.clear();
+      shares_to_1_.clear();
+    }
+  } else {
+    size_t num_from_dealer;
+    if (id_ == 2) {
+      std::vector<size_t> lengths(6);
+      network_->recv(0, lengths.data(), sizeof(size_t) * 6);
+      num_from_dealer = lengths[0];
+    } else {
+      network_->recv(0, &num_from_dealer, sizeof(size_t));
+    }
+    if (num_from_dealer != (id_ == 1 ? num_to_1 : num_to_2)) {
+      throw std::runtime_error("Received preprocessing does not match the circuit");
+    }
+
+    drawSeedsParty(input_pid_map);
+    preproc_.pipeline = std::make_shared<PreprocPipeline>(id_, network_, circ_, preproc_, pipeline_capacity_);
   }
 }
 
 
 void OfflineEvaluator::setWireMasks(
     const std::unordered_map<common::utils::wire_t, int>& input_pid_map) {
+
+  preproc_.balanced_dealer = balanced_dealer_;
+  if (pipeline_capacity_ > 0) {
+    setWireMasksPipelined(input_pid_map);
+    return;
+  }
       
     std::vector<Ring> rand_sh_sec, rand_sh_sec_to_1;
     std::vector<BoolRing> b_rand_sh_sec;
@@ -697,11 +864,12 @@ void OfflineEvaluator::setWireMasks(
     lengths[5] = b_rand_sh_party_num;
 
 
+    network_->accounting.setTag({"offline", -1, "Header"});
     network_->send(2, lengths.data(), sizeof(size_t) * 6);
     network_->send(1, &rand_sh_sec_to_1_num, sizeof(size_t));
 
     std::vector<Ring> offline_arith_comm(arith_comm);
-    std::vector<Ring> offline_arith_comm_to_1(arith_comm);
+    std::vector<Ring> offline_arith_comm_to_1(arith_comm_to_1);
     std::vector<BoolRing> offline_bool_comm(bool_comm);
     for(size_t i = 0; i < rand_sh_sec_num; i++) {
       offline_arith_comm[i] = rand_sh_sec[i];
@@ -721,46 +889,16 @@ void OfflineEvaluator::setWireMasks(
 
     auto net_data = BoolRing::pack(offline_bool_comm.data(), bool_comm);
 
-    int num_comm = arith_comm/100000000;
-    int last_comm = arith_comm%100000000;
-    for(int i = 0; i < num_comm; i++){
-      std::vector<Ring> data_send_i;
-      data_send_i.reserve(100000000);
-      for(int j = 0; j<100000000; j++){
-        data_send_i.push_back(offline_arith_comm[i*100000000 + j]);   
-      }
-
-      network_->send(2, data_send_i.data(), sizeof(Ring) * 100000000);
-    }
-                    
-    std::vector<Ring> data_send_last;
-    data_send_last.reserve(last_comm);
-    for(int j = 0; j<last_comm; j++){
-      data_send_last.push_back(offline_arith_comm[num_comm*100000000 + j]);
-    }
-    network_->send(2, data_send_last.data(), sizeof(Ring) * last_comm);
-    // network_->send(2, offline_arith_comm.data(), sizeof(Ring) * arith_comm);
-
-    num_comm = arith_comm_to_1/100000000;
-    last_comm = arith_comm_to_1%100000000;
-    for(int i = 0; i < num_comm; i++){
-      std::vector<Ring> data_send_i;
-      data_send_i.reserve(100000000);
-      for(int j = 0; j<100000000; j++){
-        data_send_i.push_back(offline_arith_comm_to_1[i*100000000 + j]);   
-      }
-
-      network_->send(1, data_send_i.data(), sizeof(Ring) * 100000000);
-    }
-                    
-    std::vector<Ring> data_send_last_to_1;
-    data_send_last_to_1.reserve(last_comm);
-    for(int j = 0; j<last_comm; j++){
-      data_send_last_to_1.push_back(offline_arith_comm_to_1[num_comm*100000000 + j]);
-    }
-    network_->send(1, data_send_last_to_1.data(), sizeof(Ring) * last_comm);
-    // network_->send(1, offline_arith_comm_to_1.data(), sizeof(Ring) * arith_comm_to_1);
+    // Segment sizes adapt to the link (see io::AdaptiveFraming), instead of fixed
+    // chunks of 100000000 elements copied before sending
+    network_->accounting.setShares({"offline", -1, ""}, std::move(shares_to_2_));
+    network_->sendBulk(2, offline_arith_comm.data(), sizeof(Ring) * arith_comm);
+    network_->accounting.setShares({"offline", -1, ""}, std::move(shares_to_1_));
+    network_->sendBulk(1, offline_arith_comm_to_1.data(), sizeof(Ring) * arith_comm_to_1);
+    shares_to_2_.clear();
+    shares_to_1_.clear();
 
+    network_->accounting.setTag({"offline", -1, "Header"});
     network_->send(2, net_data.data(), sizeof(uint8_t) * net_data.size());
 
     // network_->send(nP_, offline_bool_comm.data(), sizeof(BoolRing) * bool_comm);
@@ -770,33 +908,15 @@ void OfflineEvaluator::setWireMasks(
     size_t arith_comm_to_1;
     network_->recv(0, &arith_comm_to_1, sizeof(size_t));
 
-    int num_comm = arith_comm_to_1/100000000;
-    int last_comm = arith_comm_to_1%100000000;
     std::vector<Ring> offline_arith_comm_to_1(arith_comm_to_1);
-    for(int i = 0; i < num_comm; i++){
-      std::vector<Ring> data_recv_i(100000000);
-
-      network_->recv(0, data_recv_i.data(), sizeof(Ring) * 100000000);
-      for(int j = 0; j<100000000; j++){
-        offline_arith_comm_to_1[i*100000000 + j] = data_recv_i[j];
-      }
-    }
-                    
-    std::vector<Ring> data_recv_last(last_comm);
-    network_->recv(0, data_recv_last.data(), sizeof(Ring) * last_comm);
-    for(int j = 0; j<last_comm; j++){
-      offline_arith_comm_to_1[num_comm*100000000 + j] = data_recv_last[j];
-    }
-
-    // network_->recv(0, offline_arith_comm_to_1.data(), sizeof(Ring) * arith_comm_to_1);
+    network_->recvBulk(0, offline_arith_comm_to_1.data(), sizeof(Ring) * arith_comm_to_1);
 
     rand_sh_sec_to_1.resize(arith_comm_to_1);
     for(int i = 0; i < arith_comm_to_1; i++) {
       rand_sh_sec_to_1[i] = offline_arith_comm_to_1[i];
     }
 
-    setWireMasksParty(input_pid_map, rand_sh_sec, rand_sh_sec_to_1, b_rand_sh_sec,
-                        rand_sh_party, b_rand_sh_party);
+    setWireSeedsParty(input_pid_map, rand_sh_sec, rand_sh_sec_to_1);
 
   } else if (id_ == 2) {
     std::vector<size_t> lengths(6);
@@ -808,25 +928,9 @@ void OfflineEvaluator::setWireMasks(
     size_t bool_comm = lengths[3];
     size_t b_rand_sh_sec_num = lengths[4];
     size_t b_rand_sh_party_num = lengths[5];
-    int num_comm = arith_comm/100000000;
-    int last_comm = arith_comm%100000000;
 
     std::vector<Ring> offline_arith_comm(arith_comm);
-    for(int i = 0; i < num_comm; i++){
-      std::vector<Ring> data_recv_i(100000000);
-
-      network_->recv(0, data_recv_i.data(), sizeof(Ring) * 100000000);
-      for(int j = 0; j<100000000; j++){
-        offline_arith_comm[i*100000000 + j] = data_recv_i[j];
-      }
-    }
-                    
-    std::vector<Ring> data_recv_last(last_comm);
-    network_->recv(0, data_recv_last.data(), sizeof(Ring) * last_comm);
-    for(int j = 0; j<last_comm; j++){
-      offline_arith_comm[num_comm*100000000 + j] = data_recv_last[j];
-    }
-    // network_->recv(0, offline_arith_comm.data(), sizeof(Ring) * arith_comm);
+    network_->recvBulk(0, offline_arith_comm.data(), sizeof(Ring) * arith_comm);
     size_t nbytes = (bool_comm + 7) / 8;
     std::vector<uint8_t> net_data(nbytes);
     network_->recv(0, net_data.data(), nbytes * sizeof(uint8_t));
@@ -855,8 +959,7 @@ void OfflineEvaluator::setWireMasks(
       b_rand_sh_party[i] = offline_bool_comm[b_rand_sh_sec_num + i];
     }
     
-    setWireMasksParty(input_pid_map, rand_sh_sec, rand_sh_sec_to_1, b_rand_sh_sec,
-                        rand_sh_party, b_rand_sh_party);
+    setWireSeedsParty(input_pid_map, rand_sh_sec, rand_sh_sec_to_1);
   }
   
 }
@@ -864,6 +967,18 @@ void OfflineEvaluator::setWireMasks(
 
 
 
+void OfflineEvaluator::setLazyExpansion(bool lazy) {
+  lazy_expansion_ = lazy;
+}
+
+void OfflineEvaluator::setPipelined(size_t capacity) {
+  pipeline_capacity_ = capacity;
+}
+
+void OfflineEvaluator::setBalancedDealer(bool balanced) {
+  balanced_dealer_ = balanced;
+}
+
 PreprocCircuit<Ring> OfflineEvaluator::getPreproc() {
   return std::move(preproc_);
 }
@@ -28,6 +28,14 @@ class OfflineEvaluator {
     std::shared_ptr<ThreadPool> tpool_;
     PreprocCircuit<Ring> preproc_;
     std::vector<std::shared_ptr<std::vector<Ring> > > pis_0, pis_1, rhos_0, rhos_1;
+    bool lazy_expansion_ = false;
+    bool balanced_dealer_ = false;
+    size_t pipeline_capacity_ = 0;
+    // Bytes of the values for P2 and P1 generated by setWireMasksLevel per
+    // level and gate type, in the order of the values (see io::CommAccounting)
+    std::vector<io::CommShare> shares_to_2_, shares_to_1_;
+
+    static void addShare(std::vector<io::CommShare>& shares, const io::CommTag& tag, uint64_t bytes);
 
      public:
   
@@ -51,13 +59,60 @@ class OfflineEvaluator {
                                     std::vector<Ring>& rand_sh_sec, size_t& idx_rand_sh_sec);
 
 
+    // Same as above, but P2 derives its share and P1 receives the correction.
+    static void randomShareSecretTo1(int pid, RandGenPool& rgen,
+                                    AddShare<Ring>& share, Ring secret,
+                                    std::vector<Ring>& rand_sh_sec_to_1, size_t& idx_rand_sh_sec_to_1);
+    static void randomShareSecretBinTo1(int pid, RandGenPool& rgen,
+                                    AddShare<Ring>& share, Ring secret,
+                                    std::vector<Ring>& rand_sh_sec_to_1, size_t& idx_rand_sh_sec_to_1);
+
+
+    // Dealer (P0): generate all preprocessing and the corrections for P1 and P2.
     void setWireMasksParty(const std::unordered_map<common::utils::wire_t, int>& input_pid_map, 
           std::vector<Ring>& rand_sh_sec, std::vector<Ring>& rand_sh_sec_to_1, std::vector<BoolRing>& b_rand_sh_sec,
           std::vector<Ring>& rand_sh_party, std::vector<BoolRing>& b_rand_sh_party);
 
+    // Dealer (P0): generate the preprocessing of the gates at depth.
+    void setWireMasksLevel(size_t depth, std::vector<Ring>& rand_sh_sec, std::vector<Ring>& rand_sh_sec_to_1);
+
+    // P1/P2: draw the seeds shared with P0 for all levels and permutations.
+    void drawSeedsParty(const std::unordered_map<common::utils::wire_t, int>& input_pid_map);
+
+    // P1/P2: store the corrections P0 sends to party id for the gates at depth,
+    // read from from_dealer, in preproc. Returns the number of values read. If
+    // from_dealer is null, only counts them. perm_ready tracks the shuffle ids
+    // seen in earlier levels, whose permutations were already sent.
+    static size_t takeLevelCorrections(int id, const common::utils::LevelOrderedCircuit& circ, size_t depth,
+          const Ring* from_dealer, std::vector<bool>& perm_ready, PreprocCircuit<Ring>& preproc);
+
+    // P1/P2: store the seeds shared with P0 and the received corrections,
+    // then expand them unless lazy expansion is enabled.
+    void setWireSeedsParty(const std::unordered_map<common::utils::wire_t, int>& input_pid_map,
+          std::vector<Ring>& rand_sh_sec, std::vector<Ring>& rand_sh_sec_to_1);
+
+    // P0 streams the corrections level by level, P1/P2 hand them to a
+    // PreprocPipeline instead of waiting for all of them.
+    void setWireMasksPipelined(const std::unordered_map<common::utils::wire_t, int>& input_pid_map);
+
     void setWireMasks(const std::unordered_map<common::utils::wire_t, int>& input_pid_map);
 
 
+    // If enabled, P1 and P2 keep their preprocessing seed-compressed and the
+    // online evaluator expands it one level at a time. Disabled by default.
+    void setLazyExpansion(bool lazy);
+
+    // If capacity is non-zero, the offline phase runs concurrently to the
+    // online phase: run() returns right away on P1 and P2, and the online
+    // evaluator waits for each level of preprocessing as it needs it. At most
+    // capacity levels are buffered. Disabled (0) by default.
+    void setPipelined(size_t capacity);
+
+    // If enabled, P0 splits the corrections evenly between P1 and P2 instead of
+    // sending almost all of them to P2 (see tripleReceiver). All parties must
+    // use the same setting. Disabled by default.
+    void setBalancedDealer(bool balanced);
+
     PreprocCircuit<Ring> getPreproc();
 
     // Efficiently runs above subprotocols.
@@ -7,6 +7,8 @@
 #include "../io/netmp.h"
 #include "../utils/circuit.h"
 #include "preproc.h"
+#include "preproc_expander.h"
+#include "preproc_pipeline.h"
 #include "rand_gen_pool.h"
 #include "sharing.h"
 #include "../utils/types.h"
@@ -26,6 +28,8 @@ namespace graphsc
     std::vector<AddShare<Ring>> q_sh_;
     std::vector<Ring> q_val_;
     std::shared_ptr<ThreadPool> tpool_;
+    // Only set if preproc_ is seed-compressed.
+    std::unique_ptr<PreprocExpander> expander_;
 
     // write reconstruction function
   public:
@@ -42,10 +46,12 @@ namespace graphsc
     void setInputs(const std::unordered_map<common::utils::wire_t, Ring> &inputs);
 
     void evaluateGatesAtDepthPartySend(size_t depth,
-                                       std::vector<Ring> &mult_vals, std::vector<Ring> &and_vals, std::vector<Ring> &shuffle_vals, std::vector<Ring> &reveal_vals);
+                                       std::vector<Ring> &mult_vals, std::vector<Ring> &and_vals, std::vector<Ring> &shuffle_vals, std::vector<Ring> &reveal_vals,
+                                       std::vector<Ring> &dotprod_vals);
 
     void evaluateGatesAtDepthPartyRecv(size_t depth,
-                                       std::vector<Ring> &mult_vals, std::vector<Ring> &and_vals, std::vector<Ring> &shuffle_vals, std::vector<Ring> &reveal_vals);
+                                       std::vector<Ring> &mult_vals, std::vector<Ring> &and_vals, std::vector<Ring> &shuffle_vals, std::vector<Ring> &reveal_vals,
+                                       std::vector<Ring> &dotprod_vals);
 
     void evaluateGatesAtDepth(size_t depth);
 
@@ -1,6 +1,8 @@
 #include "online_evaluator.h"
 
 #include <array>
+#include <map>
+#include <unordered_set>
 
 #include "../utils/helpers.h"
 
@@ -20,6 +22,8 @@ namespace graphsc
           q_val_(circ.num_gates) // TODO shouldn't this be num_wires??? but also, appears to be unused
     {
         tpool_ = std::make_shared<ThreadPool>(threads);
+        if (preproc_.compressed)
+            expander_ = std::make_unique<PreprocExpander>(id_);
     }
 
     OnlineEvaluator::OnlineEvaluator(int id, std::shared_ptr<io::NetIOMP> network,
@@ -34,18 +38,22 @@ namespace graphsc
           tpool_(std::move(tpool)),
           wires_(circ.num_wires),
           q_sh_(circ.num_gates), // TODO shouldn't this be num_wires??? but also, appears to be unused
-          q_val_(circ.num_gates) {} // TODO shouldn't this be num_wires??? but also, appears to be unused
+          q_val_(circ.num_gates) // TODO shouldn't this be num_wires??? but also, appears to be unused
+    {
+        if (preproc_.compressed)
+            expander_ = std::make_unique<PreprocExpander>(id_);
+    }
 
     void OnlineEvaluator::setInputs(const std::unordered_map<common::utils::wire_t, Ring> &inputs)
     {
         if (id_ == 0) return;
+        size_t idx_input = 0;
         // Input gates have depth 0
         for (auto &g : circ_.gates_by_level[0])
         {
             if (g->type == common::utils::GateType::kInp)
             {
-                auto *pre_input = static_cast<PreprocInput<Ring> *>(preproc_.gates[g->gid].get());
-                auto pid = pre_input->pid;
+                auto pid = preproc_.input_pids[idx_input++];
 
                 if (id_ != 0)
                 {
@@ -65,8 +73,7 @@ namespace graphsc
             }
             else if (g->type == common::utils::GateType::kBinInp)
             {
-                auto *pre_input = static_cast<PreprocInput<Ring> *>(preproc_.gates[g->gid].get());
-                auto pid = pre_input->pid;
+                auto pid = preproc_.input_pids[idx_input++];
 
                 if (id_ != 0)
                 {
@@ -88,8 +95,25 @@ namespace graphsc
     }
 
     void OnlineEvaluator::evaluateGatesAtDepthPartySend(size_t depth,
-                                                        std::vector<Ring> &mult_vals, std::vector<Ring> &and_vals, std::vector<Ring> &shuffle_vals, std::vector<Ring> &reveal_vals)
+                                                        std::vector<Ring> &mult_vals, std::vector<Ring> &and_vals, std::vector<Ring> &shuffle_vals, std::vector<Ring> &reveal_vals,
+                                                        std::vector<Ring> &dotprod_vals)
     {
+        if (preproc_.pipeline)
+            preproc_.pipeline->nextLevel(depth, preproc_);
+        else if (expander_)
+            expander_->expandLevel(circ_, depth, preproc_);
+
+        size_t idx_mult = 0;
+        size_t idx_and = 0;
+        size_t idx_shuffle = 0;
+        const auto *mult_triples = preproc_.multTriples(depth);
+        const auto *and_triples = preproc_.andTriples(depth);
+        const auto *shuffle_masks = preproc_.shuffleMasks(depth);
+        size_t idx_dotprod = 0;
+        const auto *dotprod_pool = preproc_.dotprodPool(depth);
+        // Position in dotprod_vals of the input wires of dot products opened in this level
+        std::unordered_map<common::utils::wire_t, size_t> dotprod_opened;
+
         for (auto &gate : circ_.gates_by_level[depth])
         {
             switch (gate->type)
@@ -102,10 +126,9 @@ namespace graphsc
                 if (id_ != 0)
                 {
 
-                    auto *pre_out =
-                        static_cast<PreprocMultGate<Ring> *>(preproc_.gates[g->gid].get());
-                    auto xa = pre_out->triple_a.valueAt() + wires_[g->in1];
-                    auto yb = pre_out->triple_b.valueAt() + wires_[g->in2];
+                    const auto &triple = mult_triples[idx_mult++];
+                    auto xa = triple.a + wires_[g->in1];
+                    auto yb = triple.b + wires_[g->in2];
                     mult_vals.push_back(xa);
                     mult_vals.push_back(yb);
 
@@ -122,8 +145,7 @@ namespace graphsc
                 if (id_ != 0)
                 {
 
-                    auto *pre_out =
-                        static_cast<PreprocMultGate<Ring> *>(preproc_.gates[g->gid].get());
+                    const auto &triple = mult_triples[idx_mult++];
 
                     // perform a multiplication of Boolean shares x_0 and x_1
                     //
@@ -131,8 +153,8 @@ namespace graphsc
                     //
                     // where P0 sets the share of the second input to 0 and
                     // P1 sets the share of the first input to 0
-                    auto xa = pre_out->triple_a.valueAt() + (wires_[g->in] & 1) * (id_ == 1 ? 1 : 0);
-                    auto yb = pre_out->triple_b.valueAt() + (wires_[g->in] & 1) * (id_ == 1 ? 0 : 1);
+                    auto xa = triple.a + (wires_[g->in] & 1) * (id_ == 1 ? 1 : 0);
+                    auto yb = triple.b + (wires_[g->in] & 1) * (id_ == 1 ? 0 : 1);
 
                     mult_vals.push_back(xa);
                     mult_vals.push_back(yb);
@@ -150,10 +172,9 @@ namespace graphsc
                 if (id_ != 0)
                 {
 
-                    auto *pre_out =
-                        static_cast<PreprocMultGate<Ring> *>(preproc_.gates[g->gid].get());
-                    auto xa = pre_out->triple_a.valueAt() ^ wires_[g->in1];
-                    auto yb = pre_out->triple_b.valueAt() ^ wires_[g->in2];
+                    const auto &triple = and_triples[idx_and++];
+                    auto xa = triple.a ^ wires_[g->in1];
+                    auto yb = triple.b ^ wires_[g->in2];
                     and_vals.push_back(xa);
                     and_vals.push_back(yb);
                 }
@@ -169,8 +190,7 @@ namespace graphsc
                 if (id_ != 0)
                 {
 
-                    auto *pre_out =
-                        static_cast<PreprocMultGate<Ring> *>(preproc_.gates[g->gid].get());
+                    const auto &triple = and_triples[idx_and++];
 
                     auto my_share = wires_[g->in];
 
@@ -222,8 +242,8 @@ namespace graphsc
                       in2 = ~in2;
                     }
 
-                    auto xa = pre_out->triple_a.valueAt() ^ in1;
-                    auto yb = pre_out->triple_b.valueAt() ^ in2;
+                    auto xa = triple.a ^ in1;
+                    auto yb = triple.b ^ in2;
 
                     and_vals.push_back(xa);
                     and_vals.push_back(yb);
@@ -239,25 +259,24 @@ namespace graphsc
                 bool reverse = g->flag;
 
                 if (id_ != 0) {
-                    auto *pre_out = static_cast<PreprocShuffleGate<Ring> *>(preproc_.gates[g->gid].get());
-                    std::vector<Ring> *mask;
-                    if (id_ == 1)
-                        mask = &pre_out->mask_0;
-                    else
-                        mask = &pre_out->mask_1;
+                    // R_0 for P1, R_1 for P2
+                    const Ring *mask = shuffle_masks + idx_shuffle;
+                    // pi_0 for P1, pi'_1 for P2
+                    const Ring *outer = preproc_.outerPerm(g->param);
+                    // pi'_0 for P1, pi_1 for P2
+                    const Ring *inner = preproc_.innerPerm(g->param, g->in1.size());
                     vector<Ring> to_send(g->in1.size());
                     for (size_t j = 0; j < g->in1.size(); j++) {
                         if (reverse) {
                             // P0 sends pi_0^(-1)(share + R_0) and P1 sends pi'_1^(-1)(share + R_1) where R_i = masks[0]
                             // pi_0 is shuffle[0] and pi'_1 is shuffle[3], i.e.,
                             // use shuffle[i * 3].
-                            to_send[j] = wires_[g->in1[(id_ == 1 ? *(pre_out->pi_0) : *(pre_out->rho_1))[j]]]
-                                                        + (*mask)[(id_ == 1 ? *(pre_out->pi_0) : *(pre_out->rho_1))[j]];
+                            to_send[j] = wires_[g->in1[outer[j]]] + mask[outer[j]];
                         } else {
                             // P0 sends pi'_0(share + R_0) and P1 sends pi_1(share + R_1) where R_i = masks[0]
                             // pi'_0 is shuffle[1] and pi_1 is shuffle[2], i.e.,
                             // use shuffle[i + 1].
-                            to_send[(id_ == 1 ? *(pre_out->rho_0) : *(pre_out->pi_1))[j]] = wires_[g->in1[j]] + (*mask)[j];
+                            to_send[inner[j]] = wires_[g->in1[j]] + mask[j];
                         }
                     }
                     for (size_t j = 0; j < g->in1.size(); j++) {
@@ -266,6 +285,8 @@ namespace graphsc
                     }
                 }
 
+                idx_shuffle += g->in1.size();
+
                 break;
             }
 
@@ -275,18 +296,14 @@ namespace graphsc
                 auto *g = static_cast<common::utils::ThreeParamSIMDOGate *>(gate.get());
 
                 if (id_ != 0) {
-                    auto *pre_out = static_cast<PreprocShuffleGate<Ring> *>(preproc_.gates[g->gid].get());
-                    std::vector<Ring> *mask;
-                    if (id_ == 1)
-                        mask = &pre_out->mask_0;
-                    else
-                        mask = &pre_out->mask_1;
+                    const Ring *mask = shuffle_masks + idx_shuffle;
+                    const Ring *inner = preproc_.innerPerm(g->param1, g->in1.size());
                     vector<Ring> to_send(g->in1.size());
                     for (size_t j = 0; j < g->in1.size(); j++) {
                         // P0 sends pi'_0(share + R_0) and P1 sends pi_1(share + R_1) where R_i = masks[0]
                         // pi'_0 is shuffle[1] and pi_1 is shuffle[2], i.e.,
                         // use shuffle[i + 1].
-                        to_send[(id_ == 1 ? *(pre_out->rho_0) : *(pre_out->pi_1))[j]] = wires_[g->in1[j]] + (*mask)[j];
+                        to_send[inner[j]] = wires_[g->in1[j]] + mask[j];
                     }
                     for (size_t j = 0; j < g->in1.size(); j++) {
                         shuffle_vals.push_back(to_send[j]);
@@ -294,6 +311,8 @@ namespace graphsc
                     }
                 }
 
+                idx_shuffle += g->in1.size();
+
                 break;
             }
 
@@ -330,11 +349,10 @@ namespace graphsc
                     // Previously, we already subtracted s_0 from s_1, so we just compute s_0 + input * s_1
                     // s_0 is added after the communication though, here, we just multiply.
 
-                    auto *pre_out =
-                        static_cast<PreprocGenCompactionGate<Ring> *>(preproc_.gates[g->gid].get());
                     for (size_t j = 0; j < g->in1.size(); j++) {
-                        auto xa = pre_out->triple_a[j].valueAt() + wires_[g->in1[j]];
-                        auto yb = pre_out->triple_b[j].valueAt() + s_1[j];
+                        const auto &triple = mult_triples[idx_mult++];
+                        auto xa = triple.a + wires_[g->in1[j]];
+                        auto yb = triple.b + s_1[j];
                         mult_vals.push_back(xa);
                         mult_vals.push_back(yb);
                     }
@@ -360,6 +378,29 @@ namespace graphsc
                 break;
             }
 
+            case common::utils::GateType::kDotprod:
+            {
+                auto *g = static_cast<common::utils::SIMDGate *>(gate.get());
+
+                if (id_ != 0)
+                {
+                    // Open x + a for every input not opened for an earlier dot product
+                    // of this level. The opened values are shared by all dot products
+                    // using the wire, e.g., all entries of a row in a matrix product.
+                    for (size_t j = 0; j < g->in1.size(); j++) {
+                        for (auto w : {g->in1[j], g->in2[j]}) {
+                            if (dotprod_opened.emplace(w, dotprod_vals.size()).second) {
+                                dotprod_vals.push_back(wires_[w] + dotprod_pool[idx_dotprod++]);
+                            }
+                        }
+                    }
+                    // c is only needed after the exchange
+                    idx_dotprod++;
+                }
+
+                break;
+            }
+
             case ::common::utils::GateType::kAdd:
             case ::common::utils::GateType::kAddVec:
             case ::common::utils::GateType::kXor:
@@ -390,12 +431,22 @@ namespace graphsc
     }
 
     void OnlineEvaluator::evaluateGatesAtDepthPartyRecv(size_t depth,
-                                                        std::vector<Ring> &mult_vals, std::vector<Ring> &and_vals, std::vector<Ring> &shuffle_vals, std::vector<Ring> &reveal_vals)
+                                                        std::vector<Ring> &mult_vals, std::vector<Ring> &and_vals, std::vector<Ring> &shuffle_vals, std::vector<Ring> &reveal_vals,
+                                                        std::vector<Ring> &dotprod_vals)
     {
         size_t idx_mult = 0;
         size_t idx_and = 0;
         size_t idx_shuffle = 0;
         size_t idx_reveal = 0;
+        const auto *mult_triples = preproc_.multTriples(depth);
+        const auto *and_triples = preproc_.andTriples(depth);
+        const auto *shuffle_b = preproc_.shuffleB(depth);
+        size_t idx_dotprod = 0;
+        const auto *dotprod_pool = preproc_.dotprodPool(depth);
+        // Position in dotprod_vals and mask of the opened input wires of dot
+        // products, in the order in which they were opened
+        std::unordered_map<common::utils::wire_t, size_t> dotprod_opened;
+        std::vector<Ring> dotprod_masks;
 
         for (auto &gate : circ_.gates_by_level[depth])
         {
@@ -545,13 +596,11 @@ namespace graphsc
             case common::utils::GateType::kMul:
             {
                 auto *g = static_cast<common::utils::FIn2Gate *>(gate.get());
-                auto *pre_out =
-                        static_cast<PreprocMultGate<Ring> *>(preproc_.gates[g->gid].get());
-                auto a = pre_out->triple_a.valueAt();
-                auto b = pre_out->triple_b.valueAt();
-                auto c = pre_out->triple_c.valueAt();
                 if (id_ != 0)
                 {
+                    auto a = mult_triples[idx_mult].a;
+                    auto b = mult_triples[idx_mult].b;
+                    auto c = mult_triples[idx_mult].c;
                     wires_[g->out] = mult_vals[2*idx_mult]*mult_vals[2*idx_mult + 1]*(id_-1) - mult_vals[2*idx_mult]*b - mult_vals[2*idx_mult+1]*a + c;
                 }
                 idx_mult++;
@@ -561,13 +610,11 @@ namespace graphsc
             case common::utils::GateType::kConvertB2A:
             {
                 auto *g = static_cast<common::utils::FIn1Gate *>(gate.get());
-                auto *pre_out =
-                        static_cast<PreprocMultGate<Ring> *>(preproc_.gates[g->gid].get());
-                auto a = pre_out->triple_a.valueAt();
-                auto b = pre_out->triple_b.valueAt();
-                auto c = pre_out->triple_c.valueAt();
                 if (id_ != 0)
                 {
+                    auto a = mult_triples[idx_mult].a;
+                    auto b = mult_triples[idx_mult].b;
+                    auto c = mult_triples[idx_mult].c;
                     // x_0 + x_1 - 2 * x_0 * x_1
                     // ---------       ----------\
                     //  original Boolean share   |
@@ -584,13 +631,11 @@ namespace graphsc
             case common::utils::GateType::kAnd:
             {
                 auto *g = static_cast<common::utils::FIn2Gate *>(gate.get());
-                auto *pre_out =
-                        static_cast<PreprocMultGate<Ring> *>(preproc_.gates[g->gid].get());
-                auto a = pre_out->triple_a.valueAt();
-                auto b = pre_out->triple_b.valueAt();
-                auto c = pre_out->triple_c.valueAt();
                 if (id_ != 0)
                 {
+                    auto a = and_triples[idx_and].a;
+                    auto b = and_triples[idx_and].b;
+                    auto c = and_triples[idx_and].c;
                     wires_[g->out] = (and_vals[2*idx_and] & and_vals[2*idx_and + 1])*(id_-1) ^ and_vals[2*idx_and] & b ^ and_vals[2*idx_and+1] & a ^ c;
                 }
                 idx_and++;
@@ -600,13 +645,11 @@ namespace graphsc
             case common::utils::GateType::kEqualsZero:
             {
                 auto *g = static_cast<common::utils::ParamFIn1Gate *>(gate.get());
-                auto *pre_out =
-                        static_cast<PreprocMultGate<Ring> *>(preproc_.gates[g->gid].get());
-                auto a = pre_out->triple_a.valueAt();
-                auto b = pre_out->triple_b.valueAt();
-                auto c = pre_out->triple_c.valueAt();
                 if (id_ != 0)
                 {
+                    auto a = and_triples[idx_and].a;
+                    auto b = and_triples[idx_and].b;
+                    auto c = and_triples[idx_and].c;
                     auto result = (and_vals[2*idx_and] & and_vals[2*idx_and + 1])*(id_-1) ^ and_vals[2*idx_and] & b ^ and_vals[2*idx_and+1] & a ^ c;
 
                     // de morgan: a | b = ~(~a & ~b)
@@ -632,26 +675,23 @@ namespace graphsc
             {
                 auto *g = static_cast<common::utils::ParamWithFlagSIMDOGate *>(gate.get());
                 bool reverse = g->flag;
-                auto *pre_out = static_cast<PreprocShuffleGate<Ring> *>(preproc_.gates[g->gid].get());
-                std::vector<Ring> *b;
-                if (id_ == 1)
-                    b = &pre_out->b_0;
-                else
-                    b = &pre_out->b_1;
                 if (id_ != 0) {
+                    // B_0 for P1, B_1 for P2
+                    const Ring *b = shuffle_b + idx_shuffle;
+                    const Ring *outer = preproc_.outerPerm(g->param);
+                    const Ring *inner = preproc_.innerPerm(g->param, g->in1.size());
                     // Apply remaining permutation
                     for (size_t j = 0; j < g->in1.size(); j++) {
                         if (reverse) {
                             // pi'_0^(-1) for P0, pi_1^(-1) for P1, i.e.,
                             // use shuffle[i + 1].
                             // After that, subtract B_i = masks[1]
-                            wires_[g->outs[j]] = shuffle_vals[idx_shuffle + (id_ == 1 ? *(pre_out->rho_0) : *(pre_out->pi_1))[j]]- (*b)[j];
+                            wires_[g->outs[j]] = shuffle_vals[idx_shuffle + inner[j]] - b[j];
                         } else {
                             // pi_0 for P0, pi'_1 for P1, i.e.,
                             // use shuffle[i * 3].
                             // After that, subtract B_i = masks[1]
-                            wires_[g->outs[(id_ == 1 ? *(pre_out->pi_0) : *(pre_out->rho_1))[j]]] = shuffle_vals[idx_shuffle + j]
-                                                                    - (*b)[(id_ == 1 ? *(pre_out->pi_0) : *(pre_out->rho_1))[j]];
+                            wires_[g->outs[outer[j]]] = shuffle_vals[idx_shuffle + j] - b[outer[j]];
                         }
                     }
                     // for (size_t j = 0; j < g->in1.size(); j++)
@@ -666,20 +706,15 @@ namespace graphsc
             case common::utils::GateType::kDoubleShuffle: // TODO cleanup as mostly copy paste
             {
                 auto *g = static_cast<common::utils::ThreeParamSIMDOGate *>(gate.get());
-                auto *pre_out = static_cast<PreprocShuffleGate<Ring> *>(preproc_.gates[g->gid].get());
-                std::vector<Ring> *b;
-                if (id_ == 1)
-                    b = &pre_out->b_0;
-                else
-                    b = &pre_out->b_1;
                 if (id_ != 0) {
+                    const Ring *b = shuffle_b + idx_shuffle;
+                    const Ring *outer = preproc_.outerPerm(g->param1);
                     // Apply remaining permutation
                     for (size_t j = 0; j < g->in1.size(); j++) {
                         // pi_0 for P0, pi'_1 for P1, i.e.,
                         // use shuffle[i * 3].
                         // After that, subtract B_i = masks[1]
-                        wires_[g->outs[(id_ == 1 ? *(pre_out->pi_0) : *(pre_out->rho_1))[j]]] = shuffle_vals[idx_shuffle + j]
-                                                                - (*b)[(id_ == 1 ? *(pre_out->pi_0) : *(pre_out->rho_1))[j]];
+                        wires_[g->outs[outer[j]]] = shuffle_vals[idx_shuffle + j] - b[outer[j]];
                     }
                     // for (size_t j = 0; j < g->in1.size(); j++)
                     //     std::cout << "d2 " << wires_[g->outs[j]] << std::endl;
@@ -716,12 +751,10 @@ namespace graphsc
                     }
 
                     // Now, finalize the multiplications and add vector s_0.
-                    auto *pre_out =
-                        static_cast<PreprocGenCompactionGate<Ring> *>(preproc_.gates[g->gid].get());
                     for (size_t j = 0; j < g->in1.size(); j++) {
-                        auto a = pre_out->triple_a[j].valueAt();
-                        auto b = pre_out->triple_b[j].valueAt();
-                        auto c = pre_out->triple_c[j].valueAt();
+                        auto a = mult_triples[idx_mult].a;
+                        auto b = mult_triples[idx_mult].b;
+                        auto c = mult_triples[idx_mult].c;
 
                         wires_[g->outs[j]] = s_0[j] + mult_vals[2*idx_mult]*mult_vals[2*idx_mult + 1]*(id_-1) - mult_vals[2*idx_mult]*b - mult_vals[2*idx_mult+1]*a + c;
                         idx_mult++;
@@ -746,6 +779,30 @@ namespace graphsc
                 break;
             }
 
+            case common::utils::GateType::kDotprod:
+            {
+                auto *g = static_cast<common::utils::SIMDGate *>(gate.get());
+                if (id_ != 0)
+                {
+                    auto opened = [&](common::utils::wire_t w) {
+                        auto [it, fresh] = dotprod_opened.emplace(w, dotprod_masks.size());
+                        if (fresh) {
+                            dotprod_masks.push_back(dotprod_pool[idx_dotprod++]);
+                        }
+                        return it->second;
+                    };
+                    // Same as for kMul, summed up: sum of (x+a)(y+b) - (x+a)b - (y+b)a + c with c = sum of ab
+                    Ring out = 0;
+                    for (size_t j = 0; j < g->in1.size(); j++) {
+                        size_t x = opened(g->in1[j]);
+                        size_t y = opened(g->in2[j]);
+                        out += dotprod_vals[x]*dotprod_vals[y]*(id_-1) - dotprod_vals[x]*dotprod_masks[y] - dotprod_vals[y]*dotprod_masks[x];
+                    }
+                    wires_[g->out] = out + dotprod_pool[idx_dotprod++];
+                }
+                break;
+            }
+
             case common::utils::GateType::kReorder:
             {
                 auto *g = static_cast<common::utils::SIMDODoubleInGate *>(gate.get());
@@ -798,6 +855,9 @@ namespace graphsc
                 throw std::runtime_error("UNSUPPORTED GATE discovered during protocol execution (see above)");
             }
         }
+
+        if (expander_)
+            expander_->releaseLevel(circ_, depth, preproc_);
     }
 
     void OnlineEvaluator::evaluateGatesAtDepth(size_t depth)
@@ -806,11 +866,19 @@ namespace graphsc
         size_t and_num = 0;
         size_t shuffle_num = 0;
         size_t reveal_num = 0;
+        size_t dotprod_num = 0;
 
         std::vector<Ring> mult_vals;
         std::vector<Ring> and_vals;
         std::vector<Ring> shuffle_vals;
         std::vector<Ring> reveal_vals;
+        std::vector<Ring> dotprod_vals;
+
+        // Values each gate type adds to the parts of the message of this
+        // level, to attribute the communication to it
+        std::map<common::utils::GateType, size_t> mult_elems, and_elems, shuffle_elems, reveal_elems, dotprod_elems;
+        // Inputs of dot products, each of them is opened once per level
+        std::unordered_set<common::utils::wire_t> dotprod_inputs;
 
         for (auto &gate : circ_.gates_by_level[depth])
         {
@@ -826,12 +894,14 @@ namespace graphsc
             case common::utils::GateType::kConvertB2A:
             {
                 mult_num++;
+                mult_elems[gate->type] += 2;
                 break;
             }
             case common::utils::GateType::kAnd:
             case common::utils::GateType::kEqualsZero:
             {
                 and_num++;
+                and_elems[gate->type] += 2;
                 break;
             }
 
@@ -840,6 +910,7 @@ namespace graphsc
 
                 auto *g = static_cast<common::utils::ParamWithFlagSIMDOGate *>(gate.get());
                 shuffle_num += g->in1.size();
+                shuffle_elems[gate->type] += g->in1.size();
 
                 break;
             }
@@ -849,6 +920,7 @@ namespace graphsc
 
                 auto *g = static_cast<common::utils::ThreeParamSIMDOGate *>(gate.get());
                 shuffle_num += g->in1.size();
+                shuffle_elems[gate->type] += g->in1.size();
 
                 break;
             }
@@ -858,6 +930,7 @@ namespace graphsc
                 // as this consists of multiple multiplications...
                 auto *g = static_cast<common::utils::SIMDOGate *>(gate.get());
                 mult_num += g->in1.size();
+                mult_elems[gate->type] += 2 * g->in1.size();
 
                 break;
             }
@@ -866,6 +939,19 @@ namespace graphsc
             {
                 auto *g = static_cast<common::utils::SIMDOGate *>(gate.get());
                 reveal_num += g->in1.size();
+                reveal_elems[gate->type] += g->in1.size();
+
+                break;
+            }
+
+            case common::utils::GateType::kDotprod:
+            {
+                auto *g = static_cast<common::utils::SIMDGate *>(gate.get());
+                for (size_t j = 0; j < g->in1.size(); j++) {
+                    dotprod_num += dotprod_inputs.insert(g->in1[j]).second;
+                    dotprod_num += dotprod_inputs.insert(g->in2[j]).second;
+                }
+                dotprod_elems[gate->type] = dotprod_num;
 
                 break;
             }
@@ -874,11 +960,11 @@ namespace graphsc
         }
 
 
-        size_t total_comm = 2*mult_num + 2*and_num + shuffle_num + reveal_num;
+        size_t total_comm = 2*mult_num + 2*and_num + shuffle_num + reveal_num + dotprod_num;
 
         if (id_ != 0)
         {
-            evaluateGatesAtDepthPartySend(depth, mult_vals, and_vals, shuffle_vals, reveal_vals);
+            evaluateGatesAtDepthPartySend(depth, mult_vals, and_vals, shuffle_vals, reveal_vals, dotprod_vals);
             
             std::vector<Ring> data_send = mult_vals;
             data_send.reserve(total_comm);
@@ -886,82 +972,22 @@ namespace graphsc
             data_send.insert(data_send.end(), and_vals.begin(), and_vals.end());
             data_send.insert(data_send.end(), shuffle_vals.begin(), shuffle_vals.end());
             data_send.insert(data_send.end(), reveal_vals.begin(), reveal_vals.end());
+            data_send.insert(data_send.end(), dotprod_vals.begin(), dotprod_vals.end());
             
-            int seg_factor = 100000; // 100000000; // Was 100000 during LAN benchmarks as per Graphiti, optimized to less rounds for WAN here!
-            int num_comm = total_comm/seg_factor;
-            int last_comm = total_comm%seg_factor;
-            std::vector<Ring> data_recv(total_comm);
-
-
-            if (id_ == 1)
-                {   
-
-                    for(int i = 0; i < num_comm; i++){
-                       std::vector<Ring> data_send_i;
-                       data_send_i.reserve(seg_factor);
-                       for(int j = 0; j<seg_factor; j++){
-                            data_send_i.push_back(data_send[i*seg_factor + j]);   
-                       }
-
-                       network_->send(2, data_send_i.data(), sizeof(Ring) * seg_factor);
-                       std::vector<Ring> data_recv_i(seg_factor);
-
-                       network_->recv(2, data_recv_i.data(), sizeof(Ring) * seg_factor);
-                       for(int j = 0; j<seg_factor; j++){
-                            data_recv[i*seg_factor + j] = data_recv_i[j];
-                       }
-
-                    }
-                    
-
-                    std::vector<Ring> data_send_last;
-                    data_send_last.reserve(last_comm);
-                    for(int j = 0; j<last_comm; j++){
-                        data_send_last.push_back(data_send[num_comm*seg_factor + j]);
-                    }
-                    network_->send(2, data_send_last.data(), sizeof(Ring) * last_comm);
-                    std::vector<Ring> data_recv_last(last_comm);
-                    network_->recv(2, data_recv_last.data(), sizeof(Ring) * last_comm);
-                    for(int j = 0; j<last_comm; j++){
-                        data_recv[num_comm*seg_factor + j] = data_recv_last[j];
-                    }
-
+            // The message holds the parts in this order
+            std::vector<io::CommShare> shares;
+            for (const auto *part : {&mult_elems, &and_elems, &shuffle_elems, &reveal_elems, &dotprod_elems}) {
+                for (const auto &[type, elems] : *part) {
+                    shares.push_back({{"online", static_cast<int64_t>(depth), common::utils::toString(type)}, sizeof(Ring) * elems});
                 }
-            if (id_ == 2)
-                {
-
-                    for(int i = 0; i < num_comm; i++){
-
-                       std::vector<Ring> data_send_i;
-                       data_send_i.reserve(seg_factor);
-                       for(int j = 0; j<seg_factor; j++){
-                            data_send_i.push_back(data_send[i*seg_factor + j]);
-                       }
-
-                       network_->send(1, data_send_i.data(), sizeof(Ring) * seg_factor);
-                       std::vector<Ring> data_recv_i(seg_factor);
-
-                       network_->recv(1, data_recv_i.data(), sizeof(Ring) * seg_factor);
-
-                       for(int j = 0; j<seg_factor; j++){
-                            data_recv[i*seg_factor + j] = data_recv_i[j];
-                       }
-                    }
-
-                    std::vector<Ring> data_send_last;
-                    data_send_last.reserve(last_comm);
-                    for(int j = 0; j<last_comm; j++){
-                        data_send_last.push_back(data_send[num_comm*seg_factor + j]);
-                    }
-                    network_->send(1, data_send_last.data(), sizeof(Ring) * last_comm);
-                    std::vector<Ring> data_recv_last(last_comm);
+            }
+            network_->accounting.setShares({"online", static_cast<int64_t>(depth), ""}, std::move(shares));
 
-                    network_->recv(1, data_recv_last.data(), sizeof(Ring) * last_comm);
-                    for(int j = 0; j<last_comm; j++){
-                        data_recv[num_comm*seg_factor + j] = data_recv_last[j];
-                    }
-                    
-                }
+            // Segment sizes adapt to the link (see io::AdaptiveFraming), instead of the
+            // fixed 100000 elements used during the LAN benchmarks as per Graphiti
+            std::vector<Ring> data_recv(total_comm);
+            int other = id_ == 1 ? 2 : 1;
+            network_->exchange(other, data_send.data(), data_recv.data(), sizeof(Ring) * total_comm);
 
             for(int i = 0; i < mult_vals.size(); i++) {
                 mult_vals[i] += data_recv[i];
@@ -976,8 +1002,11 @@ namespace graphsc
             for (int i = 0; i < reveal_vals.size(); i++) {
                 reveal_vals[i] += data_recv[mult_vals.size() + and_vals.size() + shuffle_vals.size() + i];
             }
+            for (size_t i = 0; i < dotprod_vals.size(); i++) {
+                dotprod_vals[i] += data_recv[mult_vals.size() + and_vals.size() + shuffle_vals.size() + reveal_vals.size() + i];
+            }
             evaluateGatesAtDepthPartyRecv(depth,
-                                          mult_vals, and_vals, shuffle_vals, reveal_vals);
+                                          mult_vals, and_vals, shuffle_vals, reveal_vals, dotprod_vals);
         }
     }
 
@@ -1001,14 +1030,9 @@ namespace graphsc
                 
             }
 
-            if(id_ == 1){
-                network_->send(2, output_share_my.data(), output_share_my.size() * sizeof(Ring));
-                network_->recv(2, output_share_other.data(), output_share_other.size() * sizeof(Ring));
-            }
-            if(id_ == 2){
-                network_->send(1, output_share_my.data(), output_share_my.size() * sizeof(Ring));
-                network_->recv(1, output_share_other.data(), output_share_other.size() * sizeof(Ring));
-            }
+            network_->accounting.setTag({"online", -1, "Output"});
+            network_->exchange(id_ == 1 ? 2 : 1, output_share_my.data(), output_share_other.data(),
+                               output_share_my.size() * sizeof(Ring));
 
             for (size_t i = 0; i < circ_.outputs.size(); ++i)
             {
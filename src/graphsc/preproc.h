@@ -7,76 +7,99 @@
 using namespace common::utils;
 
 namespace graphsc {
-// Preprocessed data for a gate.
-template <class R>
-struct PreprocGate {
-
-  PreprocGate() = default;
-
-
-  virtual ~PreprocGate() = default;
-};
-
+class PreprocPipeline;
 
+// Shares of a multiplication triple, arithmetic (a * b = c) or binary (a & b = c).
 template <class R>
-using preprocg_ptr_t = std::unique_ptr<PreprocGate<R>>;
-
-template <class R>
-struct PreprocInput : public PreprocGate<R> {
-  // ID of party providing input on wire.
-  int pid{};
-  // party with id 'pid'.
-
-  PreprocInput() = default;
-  PreprocInput(int pid) 
-      : PreprocGate<R>(), pid(pid) {}
+struct TripleShare {
+  R a{};
+  R b{};
+  R c{};
 };
 
-template <class R>
-struct PreprocMultGate : public PreprocGate<R> {
-  // Secret shared product of inputs masks.
-  AddShare<R> triple_a{};
-  AddShare<R> triple_b{};
-  AddShare<R> triple_c{};
-
-
-  PreprocMultGate() = default;
-  PreprocMultGate(const AddShare<R>& triple_a, const AddShare<R>& triple_b, const AddShare<R>& triple_c)
-      : PreprocGate<R>(), triple_a(triple_a), triple_b(triple_b), triple_c(triple_c) {}
-};
-
-template <class R>
-struct PreprocShuffleGate : public PreprocGate<R> {
-  // Secret shared product of inputs masks.
-  std::vector<Ring> b_0, b_1, mask_0, mask_1;
-  std::shared_ptr<std::vector<Ring>> pi_0, pi_1, rho_0, rho_1; // Same permutation might used by multiple invocations of same shuffle
-
-  PreprocShuffleGate() = default;
-  PreprocShuffleGate(const std::shared_ptr<std::vector<Ring>>& pi_0, const std::shared_ptr<std::vector<Ring>>& pi_1, const std::shared_ptr<std::vector<Ring>>& rho_0, const std::shared_ptr<std::vector<Ring>>& rho_1, const std::vector<Ring>& b_0, const std::vector<Ring>& b_1, const std::vector<Ring>& mask_0, const std::vector<Ring>& mask_1)
-      : PreprocGate<R>(), pi_0(pi_0), pi_1(pi_1), rho_0(rho_0), rho_1(rho_1), b_0(b_0), b_1(b_1), mask_0(mask_0), mask_1(mask_1) {}
-};
-
-template <class R>
-struct PreprocGenCompactionGate : public PreprocGate<R> {
-  // Secret shared product of inputs masks.
-  std::vector<AddShare<R>> triple_a, triple_b, triple_c;
-
-  PreprocGenCompactionGate() = default;
-  PreprocGenCompactionGate(const std::vector<AddShare<R>>& triple_a, const  std::vector<AddShare<R>>& triple_b, const  std::vector<AddShare<R>>& triple_c)
-      : PreprocGate<R>(), triple_a(triple_a), triple_b(triple_b), triple_c(triple_c) {}
-};
+// In the default mode, P0 sends the correction for the share of c of every
+// triple to P2 and the second permutation of every shuffle to P2, while P1
+// derives its shares from the PRG shared with P0. With a balanced dealer, the
+// roles alternate between P1 and P2, per triple within a level and per shuffle
+// id, so that both links of P0 carry about the same traffic.
 
+// Online party receiving the correction for the k-th triple of a level.
+inline int tripleReceiver(bool balanced_dealer, size_t k) {
+  return balanced_dealer && k % 2 == 1 ? 1 : 2;
+}
 
+// Online party receiving the second permutation for the shuffle with the given id.
+inline int shufflePermReceiver(bool balanced_dealer, size_t id) {
+  return balanced_dealer && id % 2 == 1 ? 1 : 2;
+}
 
 // Preprocessed data for the circuit.
 template <class R>
 struct PreprocCircuit {
-  std::vector<preprocg_ptr_t<R>> gates;
+  // ID of the party providing the input, per input gate at depth 0 in gate order.
+  std::vector<int> input_pids;
+
+  // Per-type pools holding the material of all levels back to back. Within a
+  // level, the material is laid out in the order in which the online evaluator
+  // consumes it, i.e., in gate order. The offsets hold the start of every level
+  // in the respective pool, followed by the end of the last level.
+  // Arithmetic triples: one per kMul and kConvertB2A, one per element of kGenCompaction.
+  std::vector<TripleShare<R>> mult_triples;
+  std::vector<size_t> mult_offsets;
+  // Binary triples: one per kAnd and kEqualsZero.
+  std::vector<TripleShare<R>> and_triples;
+  std::vector<size_t> and_offsets;
+  // Dot products (kDotprod): every input wire of the dot products of a level is
+  // opened once with a random mask, however many of them use it. Per gate, the
+  // pool holds the masks of the inputs not used by an earlier dot product of
+  // the level, in1[i] before in2[i], followed by the share of c, the dot
+  // product of the masks of in1 and in2.
+  std::vector<R> dotprod_pool;
+  std::vector<size_t> dotprod_offsets;
+  // Shuffle masks R_i and B_i: one each per element of kShuffle and kDoubleShuffle.
+  std::vector<R> shuffle_masks;
+  std::vector<R> shuffle_b;
+  std::vector<size_t> shuffle_offsets;
+  // Per shuffle id, the two permutations held by this party, stored back to
+  // back starting at perm_offsets[id]: first the outer permutation (pi_0 for P1,
+  // pi'_1 for P2), then the inner one (pi'_0 for P1, pi_1 for P2). The same
+  // permutations are used by all shuffles with this id.
+  std::vector<R> perms;
+  std::vector<size_t> perm_offsets;
+
+  // Seed-compressed form kept by P1 and P2 if lazy expansion is enabled, see
+  // PreprocExpander. All material derived from the PRG shared with P0 is
+  // represented by a seed, only the corrections sent by P0 are stored in full.
+  // While expanding lazily, the pools above only hold the current level.
+  bool compressed{false};
+  // Whether P0 used a balanced dealer, see tripleReceiver.
+  bool balanced_dealer{false};
+  // Per level: seed of the PRG stream shared with P0 and the corrections
+  // received for the gates of that level, in gate order.
+  std::vector<emp::block> level_seeds;
+  std::vector<std::vector<R>> level_corrections;
+  // Per shuffle id: seed of the permutations shared with P0 and the
+  // permutation received from P0 (empty if there is none).
+  std::vector<emp::block> perm_seeds;
+  std::vector<std::shared_ptr<std::vector<R>>> perm_corrections;
+
+  // Set on P1 and P2 if the offline phase runs concurrently to the online
+  // phase. The levels are then taken from the pipeline one at a time and the
+  // pools only hold the current level.
+  std::shared_ptr<PreprocPipeline> pipeline;
 
   PreprocCircuit() = default;
-  PreprocCircuit(size_t num_gates)
-      : gates(num_gates) {}
-        
+
+  // Start of the material of the given level in the respective pool.
+  const TripleShare<R>* multTriples(size_t depth) const { return mult_triples.data() + mult_offsets[depth]; }
+  const TripleShare<R>* andTriples(size_t depth) const { return and_triples.data() + and_offsets[depth]; }
+  const R* dotprodPool(size_t depth) const { return dotprod_pool.data() + dotprod_offsets[depth]; }
+  const R* shuffleMasks(size_t depth) const { return shuffle_masks.data() + shuffle_offsets[depth]; }
+  const R* shuffleB(size_t depth) const { return shuffle_b.data() + shuffle_offsets[depth]; }
+
+  // Permutations of length n for the given shuffle id.
+  const R* outerPerm(size_t id) const { return perms.data() + perm_offsets[id]; }
+  const R* innerPerm(size_t id, size_t n) const { return perms.data() + perm_offsets[id] + n; }
 };
 
 
@@ -0,0 +1,246 @@
+#include "preproc_expander.h"
+
+namespace graphsc {
+
+PreprocExpander::PreprocExpander(int my_id) : id_(my_id) {
+    if (my_id != 1 && my_id != 2) {
+        throw std::invalid_argument("Only P1 and P2 can expand seed-compressed preprocessing");
+    }
+}
+
+// Draws the next triple shared with P0, c is received by the party given by
+// tripleReceiver and drawn by the other one.
+static void appendTriple(bool received, emp::PRG& prg, const std::vector<Ring>& corrections, size_t& idx,
+                         std::vector<TripleShare<Ring>>& pool) {
+    // Arithmetic and binary triples only differ in how P0 combines its shares.
+    TripleShare<Ring> triple;
+    prg.random_data(&triple.a, sizeof(Ring));
+    prg.random_data(&triple.b, sizeof(Ring));
+    if (!received) {
+        prg.random_data(&triple.c, sizeof(Ring));
+    } else {
+        triple.c = corrections[idx++];
+    }
+    pool.push_back(triple);
+}
+
+void PreprocExpander::expandPermutations(size_t param, size_t n, bool double_shuffle, PreprocCircuit<Ring>& preproc) {
+    if (param < perm_ready_.size() && perm_ready_[param]) {
+        return; // already expanded for an earlier gate
+    }
+    if (param >= perm_ready_.size()) {
+        perm_ready_.resize(param + 1, false);
+    }
+    if (param >= preproc.perm_offsets.size()) {
+        preproc.perm_offsets.resize(param + 1);
+    }
+    perm_ready_[param] = true;
+    preproc.perm_offsets[param] = preproc.perms.size();
+
+    // Same order as the dealer: for a shuffle, pi_0 and pi'_0 are derived with P1 and
+    // pi_1 with P2 (or pi_0 with P1 and pi_1 and pi'_1 with P2 if P1 receives pi'_0),
+    // for a double shuffle, pi_0 is derived with P1 and pi'_1 with P2.
+    emp::PRG prg(&preproc.perm_seeds[param]);
+    const auto& received = *preproc.perm_corrections[param];
+    std::vector<Ring> outer, inner;
+    if (!double_shuffle && shufflePermReceiver(preproc.balanced_dealer, param) == 1) {
+        if (id_ == 1) {
+            randomPermutation(prg, n, outer);
+            inner = received;
+        } else {
+            randomPermutation(prg, n, inner);
+            randomPermutation(prg, n, outer);
+        }
+    } else if (!double_shuffle) {
+        if (id_ == 1) {
+            randomPermutation(prg, n, outer);
+            randomPermutation(prg, n, inner);
+        } else {
+            randomPermutation(prg, n, inner);
+            outer = received;
+        }
+    } else {
+        randomPermutation(prg, n, outer);
+        inner = received;
+    }
+    preproc.perms.insert(preproc.perms.end(), outer.begin(), outer.end());
+    preproc.perms.insert(preproc.perms.end(), inner.begin(), inner.end());
+}
+
+void PreprocExpander::appendLevel(const common::utils::LevelOrderedCircuit& circ, size_t depth, PreprocCircuit<Ring>& preproc) {
+    emp::PRG prg(&preproc.level_seeds[depth]);
+    const auto& corrections = preproc.level_corrections[depth];
+    size_t idx = 0;
+    size_t num_triples = 0;
+    // Input wires of dot products of this level that already have a mask
+    std::unordered_set<common::utils::wire_t> masked;
+
+    preproc.mult_offsets[depth] = preproc.mult_triples.size();
+    preproc.dotprod_offsets[depth] = preproc.dotprod_pool.size();
+    preproc.and_offsets[depth] = preproc.and_triples.size();
+    preproc.shuffle_offsets[depth] = preproc.shuffle_masks.size();
+
+    for (const auto& gate : circ.gates_by_level[depth]) {
+        switch (gate->type) {
+
+            case common::utils::GateType::kMul:
+            case common::utils::GateType::kConvertB2A: {
+                bool received = tripleReceiver(preproc.balanced_dealer, num_triples++) == id_;
+                appendTriple(received, prg, corrections, idx, preproc.mult_triples);
+                break;
+            }
+
+            case common::utils::GateType::kAnd:
+            case common::utils::GateType::kEqualsZero: {
+                bool received = tripleReceiver(preproc.balanced_dealer, num_triples++) == id_;
+                appendTriple(received, prg, corrections, idx, preproc.and_triples);
+                break;
+            }
+
+            case common::utils::GateType::kGenCompaction: {
+                auto *g = static_cast<common::utils::SIMDOGate *>(gate.get());
+                for (size_t j = 0; j < g->in1.size(); j++) {
+                    bool received = tripleReceiver(preproc.balanced_dealer, num_triples++) == id_;
+                    appendTriple(received, prg, corrections, idx, preproc.mult_triples);
+                }
+                break;
+            }
+
+            case common::utils::GateType::kDotprod: {
+                auto *g = static_cast<common::utils::SIMDGate *>(gate.get());
+                for (size_t j = 0; j < g->in1.size(); j++) {
+                    for (auto w : {g->in1[j], g->in2[j]}) {
+                        if (masked.insert(w).second) {
+                            Ring mask;
+                            prg.random_data(&mask, sizeof(Ring));
+                            preproc.dotprod_pool.push_back(mask);
+                        }
+                    }
+                }
+                Ring c;
+                if (tripleReceiver(preproc.balanced_dealer, num_triples++) == id_) {
+                    c = corrections[idx++];
+                } else {
+                    prg.random_data(&c, sizeof(Ring));
+                }
+                preproc.dotprod_pool.push_back(c);
+                break;
+            }
+
+            case common::utils::GateType::kShuffle:
+            case common::utils::GateType::kDoubleShuffle: {
+                bool double_shuffle = gate->type == common::utils::GateType::kDoubleShuffle;
+                size_t param;
+                size_t n;
+                if (double_shuffle) {
+                    auto *g = static_cast<common::utils::ThreeParamSIMDOGate *>(gate.get());
+                    param = g->param1;
+                    n = g->in1.size();
+                } else {
+                    auto *g = static_cast<common::utils::ParamWithFlagSIMDOGate *>(gate.get());
+                    param = g->param;
+                    n = g->in1.size();
+                }
+                expandPermutations(param, n, double_shuffle, preproc);
+
+                std::vector<Ring> mask;
+                randomRingElements(prg, n, mask);
+                preproc.shuffle_masks.insert(preproc.shuffle_masks.end(), mask.begin(), mask.end());
+                preproc.shuffle_b.insert(preproc.shuffle_b.end(), corrections.begin() + idx, corrections.begin() + idx + n);
+                idx += n;
+                break;
+            }
+
+            default: {
+                break;
+            }
+        }
+    }
+
+    if (idx != corrections.size()) {
+        throw std::runtime_error("Seed-compressed preprocessing does not match the circuit");
+    }
+
+    preproc.mult_offsets[depth + 1] = preproc.mult_triples.size();
+    preproc.dotprod_offsets[depth + 1] = preproc.dotprod_pool.size();
+    preproc.and_offsets[depth + 1] = preproc.and_triples.size();
+    preproc.shuffle_offsets[depth + 1] = preproc.shuffle_masks.size();
+}
+
+void PreprocExpander::clearPools(const common::utils::LevelOrderedCircuit& circ, PreprocCircuit<Ring>& preproc) {
+    preproc.mult_triples.clear();
+    preproc.dotprod_pool.clear();
+    preproc.and_triples.clear();
+    preproc.shuffle_masks.clear();
+    preproc.shuffle_b.clear();
+    preproc.perms.clear();
+    preproc.mult_offsets.resize(circ.gates_by_level.size() + 1);
+    preproc.dotprod_offsets.resize(circ.gates_by_level.size() + 1);
+    preproc.and_offsets.resize(circ.gates_by_level.size() + 1);
+    preproc.shuffle_offsets.resize(circ.gates_by_level.size() + 1);
+    perm_ready_.clear();
+}
+
+void PreprocExpander::expandLevel(const common::utils::LevelOrderedCircuit& circ, size_t depth, PreprocCircuit<Ring>& preproc) {
+    clearPools(circ, preproc);
+    appendLevel(circ, depth, preproc);
+}
+
+void PreprocExpander::expandAll(const common::utils::LevelOrderedCircuit& circ, PreprocCircuit<Ring>& preproc) {
+    clearPools(circ, preproc);
+
+    // Allocate every pool once
+    size_t num_mult = 0, num_and = 0, num_shuffle = 0;
+    for (const auto& level : circ.gates_by_level) {
+        for (const auto& gate : level) {
+            switch (gate->type) {
+                case common::utils::GateType::kMul:
+                case common::utils::GateType::kConvertB2A:
+                    num_mult++;
+                    break;
+                case common::utils::GateType::kAnd:
+                case common::utils::GateType::kEqualsZero:
+                    num_and++;
+                    break;
+                case common::utils::GateType::kGenCompaction:
+                    num_mult += static_cast<common::utils::SIMDOGate *>(gate.get())->in1.size();
+                    break;
+                case common::utils::GateType::kShuffle:
+                    num_shuffle += static_cast<common::utils::ParamWithFlagSIMDOGate *>(gate.get())->in1.size();
+                    break;
+                case common::utils::GateType::kDoubleShuffle:
+                    num_shuffle += static_cast<common::utils::ThreeParamSIMDOGate *>(gate.get())->in1.size();
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    preproc.mult_triples.reserve(num_mult);
+    preproc.and_triples.reserve(num_and);
+    preproc.shuffle_masks.reserve(num_shuffle);
+    preproc.shuffle_b.reserve(num_shuffle);
+
+    for (size_t depth = 0; depth < circ.gates_by_level.size(); depth++) {
+        appendLevel(circ, depth, preproc);
+        preproc.level_corrections[depth] = std::vector<Ring>();
+    }
+    preproc.compressed = false;
+    preproc.level_seeds = std::vector<emp::block>();
+    preproc.level_corrections = std::vector<std::vector<Ring>>();
+    preproc.perm_seeds = std::vector<emp::block>();
+    preproc.perm_corrections = std::vector<std::shared_ptr<std::vector<Ring>>>();
+}
+
+void PreprocExpander::releaseLevel(const common::utils::LevelOrderedCircuit& circ, size_t depth, PreprocCircuit<Ring>& preproc) {
+    preproc.mult_triples = std::vector<TripleShare<Ring>>();
+    preproc.dotprod_pool = std::vector<Ring>();
+    preproc.and_triples = std::vector<TripleShare<Ring>>();
+    preproc.shuffle_masks = std::vector<Ring>();
+    preproc.shuffle_b = std::vector<Ring>();
+    preproc.perms = std::vector<Ring>();
+    preproc.level_corrections[depth] = std::vector<Ring>();
+    perm_ready_.clear();
+}
+
+};
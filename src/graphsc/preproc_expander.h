@@ -0,0 +1,50 @@
+#pragma once
+
+#include <emp-tool/emp-tool.h>
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "../utils/circuit.h"
+#include "preproc.h"
+#include "rand_gen_pool.h"
+#include "../utils/types.h"
+
+using namespace common::utils;
+
+namespace graphsc {
+
+// Regenerates the preprocessing of an online party (P1 or P2) from the
+// seed-compressed form of a PreprocCircuit, one level at a time.
+//
+// For every level, P0 and the online party derive a PRG from a shared level
+// seed. Triple shares, masks of dot product inputs and shuffle masks are drawn
+// from it in gate order, the same way P0 draws them in
+// OfflineEvaluator::setWireMasksParty. Permutations are drawn from a PRG
+// seeded per shuffle id, as they are reused across levels.
+// The result is written to the typed pools of the PreprocCircuit.
+class PreprocExpander {
+    int id_;
+    // Shuffle ids whose permutations are currently held in preproc.perms.
+    std::vector<bool> perm_ready_;
+
+    void expandPermutations(size_t param, size_t n, bool double_shuffle, PreprocCircuit<Ring>& preproc);
+    // Appends the material of the given level to the pools of preproc.
+    void appendLevel(const common::utils::LevelOrderedCircuit& circ, size_t depth, PreprocCircuit<Ring>& preproc);
+    void clearPools(const common::utils::LevelOrderedCircuit& circ, PreprocCircuit<Ring>& preproc);
+
+  public:
+    explicit PreprocExpander(int my_id);
+
+    // Replaces the pools of preproc with the material of the given level.
+    void expandLevel(const common::utils::LevelOrderedCircuit& circ, size_t depth, PreprocCircuit<Ring>& preproc);
+
+    // Expands all levels and drops the seed-compressed form afterwards.
+    void expandAll(const common::utils::LevelOrderedCircuit& circ, PreprocCircuit<Ring>& preproc);
+
+    // Frees the material of the given level, including the permutations.
+    void releaseLevel(const common::utils::LevelOrderedCircuit& circ, size_t depth, PreprocCircuit<Ring>& preproc);
+};
+
+};
@@ -0,0 +1,128 @@
+#include "preproc_pipeline.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "offline_evaluator.h"
+#include "preproc_expander.h"
+
+namespace graphsc {
+
+PreprocPipeline::PreprocPipeline(int my_id, std::shared_ptr<io::NetIOMP> network,
+                                 common::utils::LevelOrderedCircuit circ, PreprocCircuit<Ring>& preproc, size_t capacity)
+    : id_(my_id),
+      network_(std::move(network)),
+      circ_(std::move(circ)),
+      capacity_(std::max<size_t>(capacity, 1)) {
+    if (my_id != 1 && my_id != 2) {
+        throw std::invalid_argument("Only P1 and P2 receive preprocessing in a pipeline");
+    }
+    work_.level_seeds = std::move(preproc.level_seeds);
+    work_.level_corrections = std::move(preproc.level_corrections);
+    work_.perm_seeds = std::move(preproc.perm_seeds);
+    work_.perm_corrections = std::move(preproc.perm_corrections);
+    work_.compressed = true;
+    work_.balanced_dealer = preproc.balanced_dealer;
+
+    worker_ = std::thread(&PreprocPipeline::run, this);
+}
+
+PreprocPipeline::~PreprocPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        cv_.notify_all();
+    }
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void PreprocPipeline::run() {
+    try {
+        PreprocExpander expander(id_);
+        std::vector<bool> perm_ready;
+
+        for (size_t depth = 0; depth < circ_.gates_by_level.size(); depth++) {
+            auto perm_ready_count = perm_ready;
+            size_t num = OfflineEvaluator::takeLevelCorrections(id_, circ_, depth, nullptr, perm_ready_count, work_);
+            std::vector<Ring> from_dealer(num);
+            if (num > 0) {
+                network_->recv(0, from_dealer.data(), sizeof(Ring) * num);
+            }
+            OfflineEvaluator::takeLevelCorrections(id_, circ_, depth, from_dealer.data(), perm_ready, work_);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stop_) {
+                    // Nobody takes this level anymore, only keep receiving
+                    continue;
+                }
+            }
+
+            expander.expandLevel(circ_, depth, work_);
+            PreprocLevel level;
+            level.mult_triples = std::move(work_.mult_triples);
+            level.dotprod_pool = std::move(work_.dotprod_pool);
+            level.and_triples = std::move(work_.and_triples);
+            level.shuffle_masks = std::move(work_.shuffle_masks);
+            level.shuffle_b = std::move(work_.shuffle_b);
+            level.perms = std::move(work_.perms);
+            level.perm_offsets = work_.perm_offsets;
+            expander.releaseLevel(circ_, depth, work_);
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return queue_.size() < capacity_ || stop_; });
+            if (stop_) {
+                continue;
+            }
+            queue_.push_back(std::move(level));
+            cv_.notify_all();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = std::current_exception();
+        cv_.notify_all();
+    }
+}
+
+void PreprocPipeline::nextLevel(size_t depth, PreprocCircuit<Ring>& preproc) {
+    PreprocLevel level;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (depth != next_depth_) {
+            throw std::logic_error("Expected preprocessing of level " + std::to_string(next_depth_) +
+                                   " from the pipeline, but level " + std::to_string(depth) + " was requested");
+        }
+        cv_.wait(lock, [this] { return !queue_.empty() || error_; });
+        if (queue_.empty()) {
+            std::rethrow_exception(error_);
+        }
+        level = std::move(queue_.front());
+        queue_.pop_front();
+        next_depth_++;
+        cv_.notify_all();
+    }
+
+    size_t num_levels = circ_.gates_by_level.size() + 1;
+    preproc.mult_offsets.resize(num_levels);
+    preproc.dotprod_offsets.resize(num_levels);
+    preproc.and_offsets.resize(num_levels);
+    preproc.shuffle_offsets.resize(num_levels);
+    preproc.mult_offsets[depth] = 0;
+    preproc.mult_offsets[depth + 1] = level.mult_triples.size();
+    preproc.dotprod_offsets[depth] = 0;
+    preproc.dotprod_offsets[depth + 1] = level.dotprod_pool.size();
+    preproc.and_offsets[depth] = 0;
+    preproc.and_offsets[depth + 1] = level.and_triples.size();
+    preproc.shuffle_offsets[depth] = 0;
+    preproc.shuffle_offsets[depth + 1] = level.shuffle_masks.size();
+    preproc.mult_triples = std::move(level.mult_triples);
+    preproc.dotprod_pool = std::move(level.dotprod_pool);
+    preproc.and_triples = std::move(level.and_triples);
+    preproc.shuffle_masks = std::move(level.shuffle_masks);
+    preproc.shuffle_b = std::move(level.shuffle_b);
+    preproc.perms = std::move(level.perms);
+    preproc.perm_offsets = std::move(level.perm_offsets);
+}
+
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../io/netmp.h"
+#include "../utils/circuit.h"
+#include "preproc.h"
+#include "../utils/types.h"
+
+using namespace common::utils;
+
+namespace graphsc {
+
+// Expanded preprocessing of a single level, see PreprocCircuit for the layout.
+struct PreprocLevel {
+    std::vector<TripleShare<Ring>> mult_triples;
+    std::vector<Ring> dotprod_pool;
+    std::vector<TripleShare<Ring>> and_triples;
+    std::vector<Ring> shuffle_masks;
+    std::vector<Ring> shuffle_b;
+    std::vector<Ring> perms;
+    std::vector<size_t> perm_offsets;
+};
+
+// Offline phase of P1 or P2 running concurrently to the online phase.
+//
+// A worker thread receives the corrections P0 streams level by level (see
+// OfflineEvaluator::setWireMasksPipelined), expands each level and publishes
+// it through a bounded queue. The online evaluator takes the levels in order,
+// so the evaluation of a level starts as soon as its preprocessing is ready.
+// While the queue is full, the worker stops receiving and P0 is held back by
+// the network.
+class PreprocPipeline {
+    int id_;
+    std::shared_ptr<io::NetIOMP> network_;
+    common::utils::LevelOrderedCircuit circ_;
+    // Seed-compressed form, filled by the worker one level at a time.
+    PreprocCircuit<Ring> work_;
+    size_t capacity_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<PreprocLevel> queue_;
+    std::exception_ptr error_;
+    // Depth the next call to nextLevel must ask for
+    size_t next_depth_ = 0;
+    // Set on destruction, the worker then only drains what P0 still sends
+    bool stop_ = false;
+    std::thread worker_;
+
+    void run();
+
+  public:
+    // Takes over the seeds of preproc drawn by OfflineEvaluator::drawSeedsParty.
+    PreprocPipeline(int my_id, std::shared_ptr<io::NetIOMP> network,
+                    common::utils::LevelOrderedCircuit circ, PreprocCircuit<Ring>& preproc, size_t capacity);
+
+    // Stops the worker and waits for it. If the online phase did not take all
+    // levels, e.g., because it failed, P0 still streams the remaining ones. The
+    // worker receives and discards them without expanding, so it does not stay
+    // blocked on a full queue or in a receive and the connection from P0 is
+    // left at a message boundary.
+    ~PreprocPipeline();
+
+    PreprocPipeline(const PreprocPipeline&) = delete;
+    PreprocPipeline& operator=(const PreprocPipeline&) = delete;
+
+    // Blocks until the preprocessing of the next level is ready and replaces
+    // the pools of preproc with it. Levels must be taken in order, throws
+    // otherwise. Rethrows errors of the worker.
+    void nextLevel(size_t depth, PreprocCircuit<Ring>& preproc);
+};
+
+};
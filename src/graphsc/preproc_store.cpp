@@ -0,0 +1,244 @@
+#include "preproc_store.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "preproc_expander.h"
+
+namespace graphsc {
+
+static const char PREPROC_MAGIC[8] = {'M', 'C', 'P', 'R', 'E', 'P', 'R', 'O'};
+static const uint32_t PREPROC_VERSION = 2;
+static const uint64_t PREPROC_FLAG_BALANCED_DEALER = 1;
+static const uint64_t PREPROC_FLAG_CONSUMED = 2;
+
+struct PreprocFileHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t pid;
+  uint64_t fingerprint;
+  uint64_t num_levels;
+  uint64_t num_perms;
+  uint64_t num_inputs;
+  uint64_t note_size;
+  uint64_t flags;
+};
+
+template <class T>
+static void writeArray(std::ofstream& out, const T* data, size_t len) {
+  out.write(reinterpret_cast<const char*>(data), sizeof(T) * len);
+}
+
+void savePreproc(const std::string& path, int id, const common::utils::LevelOrderedCircuit& circ,
+                 const PreprocCircuit<Ring>& preproc, const std::string& note) {
+  if (id != 0 && !preproc.compressed) {
+    throw std::invalid_argument("Only seed-compressed preprocessing can be stored, enable lazy expansion");
+  }
+
+  std::vector<int32_t> input_pids(preproc.input_pids.begin(), preproc.input_pids.end());
+
+  PreprocFileHeader header{};
+  std::memcpy(header.magic, PREPROC_MAGIC, sizeof(PREPROC_MAGIC));
+  header.version = PREPROC_VERSION;
+  header.pid = id;
+  header.fingerprint = circ.fingerprint();
+  header.num_levels = preproc.level_seeds.size();
+  header.num_perms = preproc.perm_seeds.size();
+  header.num_inputs = input_pids.size();
+  header.note_size = note.size();
+  header.flags = preproc.balanced_dealer ? PREPROC_FLAG_BALANCED_DEALER : 0;
+
+  std::vector<uint64_t> level_sizes, perm_sizes;
+  for (const auto& corrections : preproc.level_corrections) {
+    level_sizes.push_back(corrections.size());
+  }
+  for (const auto& corrections : preproc.perm_corrections) {
+    perm_sizes.push_back(corrections ? corrections->size() : 0);
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.good()) {
+    throw std::runtime_error("Could not open " + path + " for writing preprocessing");
+  }
+  writeArray(out, &header, 1);
+  writeArray(out, note.data(), note.size());
+  writeArray(out, input_pids.data(), input_pids.size());
+  writeArray(out, preproc.level_seeds.data(), preproc.level_seeds.size());
+  writeArray(out, level_sizes.data(), level_sizes.size());
+  writeArray(out, preproc.perm_seeds.data(), preproc.perm_seeds.size());
+  writeArray(out, perm_sizes.data(), perm_sizes.size());
+  for (const auto& corrections : preproc.level_corrections) {
+    writeArray(out, corrections.data(), corrections.size());
+  }
+  for (const auto& corrections : preproc.perm_corrections) {
+    if (corrections) {
+      writeArray(out, corrections->data(), corrections->size());
+    }
+  }
+  out.close();
+  if (!out.good()) {
+    throw std::runtime_error("Could not write preprocessing to " + path);
+  }
+}
+
+// Read-only mapping of a file, unmapped on destruction.
+class MappedFile {
+  void* data_ = MAP_FAILED;
+  size_t size_ = 0;
+
+ public:
+  explicit MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open stored preprocessing " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw std::runtime_error("Could not stat stored preprocessing " + path);
+    }
+    size_ = st.st_size;
+    if (size_ > 0) {
+      data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data_ == MAP_FAILED) {
+      throw std::runtime_error("Could not map stored preprocessing " + path);
+    }
+    madvise(data_, size_, MADV_SEQUENTIAL);
+  }
+  ~MappedFile() {
+    if (data_ != MAP_FAILED) {
+      munmap(data_, size_);
+    }
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const { return static_cast<const char*>(data_); }
+  size_t size() const { return size_; }
+};
+
+// Sequential reader over the mapped file with bounds checks.
+class MappedReader {
+  const MappedFile& file_;
+  size_t pos_ = 0;
+
+ public:
+  explicit MappedReader(const MappedFile& file) : file_(file) {}
+
+  template <class T>
+  void read(T* dst, size_t len) {
+    if (len > (file_.size() - pos_) / sizeof(T)) {
+      throw std::runtime_error("Stored preprocessing is truncated");
+    }
+    std::memcpy(dst, file_.data() + pos_, sizeof(T) * len);
+    pos_ += sizeof(T) * len;
+  }
+
+  bool done() const { return pos_ == file_.size(); }
+};
+
+// Sets the consumed flag in the header of the file, see loadPreproc.
+static void markConsumed(const std::string& path, uint64_t flags) {
+  flags |= PREPROC_FLAG_CONSUMED;
+  int fd = open(path.c_str(), O_WRONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open stored preprocessing " + path + " to mark it as consumed");
+  }
+  auto res = pwrite(fd, &flags, sizeof(flags), offsetof(PreprocFileHeader, flags));
+  bool ok = res == static_cast<ssize_t>(sizeof(flags)) && fsync(fd) == 0;
+  close(fd);
+  if (!ok) {
+    throw std::runtime_error("Could not mark stored preprocessing " + path + " as consumed");
+  }
+}
+
+PreprocCircuit<Ring> loadPreproc(const std::string& path, int id, const common::utils::LevelOrderedCircuit& circ,
+                                 bool expand, std::string* note) {
+  MappedFile file(path);
+  MappedReader reader(file);
+
+  PreprocFileHeader header;
+  reader.read(&header, 1);
+  if (std::memcmp(header.magic, PREPROC_MAGIC, sizeof(PREPROC_MAGIC)) != 0 || header.version != PREPROC_VERSION) {
+    throw std::runtime_error(path + " is not a preprocessing file of this version");
+  }
+  if (header.pid != id) {
+    throw std::runtime_error(path + " contains preprocessing of party " + std::to_string(header.pid));
+  }
+  if (header.fingerprint != circ.fingerprint()) {
+    throw std::runtime_error(path + " contains preprocessing for a different circuit");
+  }
+  if ((header.flags & PREPROC_FLAG_CONSUMED) != 0) {
+    throw std::runtime_error(path + " was already used by an online phase, run the offline phase again");
+  }
+
+  std::string stored_note(header.note_size, '\0');
+  reader.read(stored_note.data(), stored_note.size());
+  if (note != nullptr) {
+    *note = stored_note;
+  }
+
+  PreprocCircuit<Ring> preproc;
+  if (id == 0) {
+    markConsumed(path, header.flags);
+    return preproc;
+  }
+
+  std::vector<int32_t> input_pids(header.num_inputs);
+  reader.read(input_pids.data(), input_pids.size());
+  size_t num_inputs = 0;
+  for (const auto& gate : circ.gates_by_level[0]) {
+    if (gate->type == common::utils::GateType::kInp || gate->type == common::utils::GateType::kBinInp) {
+      num_inputs++;
+    }
+  }
+  if (num_inputs != input_pids.size()) {
+    throw std::runtime_error("Stored preprocessing does not match the circuit inputs");
+  }
+  preproc.input_pids.assign(input_pids.begin(), input_pids.end());
+
+  if (header.num_levels != circ.gates_by_level.size()) {
+    throw std::runtime_error("Stored preprocessing does not match the circuit depth");
+  }
+  preproc.level_seeds.resize(header.num_levels);
+  reader.read(preproc.level_seeds.data(), preproc.level_seeds.size());
+  std::vector<uint64_t> level_sizes(header.num_levels);
+  reader.read(level_sizes.data(), level_sizes.size());
+  preproc.perm_seeds.resize(header.num_perms);
+  reader.read(preproc.perm_seeds.data(), preproc.perm_seeds.size());
+  std::vector<uint64_t> perm_sizes(header.num_perms);
+  reader.read(perm_sizes.data(), perm_sizes.size());
+
+  preproc.level_corrections.resize(header.num_levels);
+  for (size_t i = 0; i < header.num_levels; i++) {
+    preproc.level_corrections[i].resize(level_sizes[i]);
+    reader.read(preproc.level_corrections[i].data(), level_sizes[i]);
+  }
+  preproc.perm_corrections.resize(header.num_perms);
+  for (size_t i = 0; i < header.num_perms; i++) {
+    preproc.perm_corrections[i] = std::make_shared<std::vector<Ring>>(perm_sizes[i]);
+    reader.read(preproc.perm_corrections[i]->data(), perm_sizes[i]);
+  }
+  if (!reader.done()) {
+    throw std::runtime_error("Stored preprocessing has trailing data");
+  }
+  markConsumed(path, header.flags);
+  preproc.compressed = true;
+  preproc.balanced_dealer = (header.flags & PREPROC_FLAG_BALANCED_DEALER) != 0;
+
+  if (expand) {
+    PreprocExpander(id).expandAll(circ, preproc);
+  }
+  return preproc;
+}
+
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+
+#include "../utils/circuit.h"
+#include "preproc.h"
+#include "../utils/types.h"
+
+using namespace common::utils;
+
+namespace graphsc {
+
+// On-disk format for the preprocessing of one party, so that the offline and
+// online phase can run at different times.
+//
+// The seed-compressed form of a PreprocCircuit is stored (see
+// PreprocExpander), including the seeds and received values of the shuffle
+// permutations. All sections are flat arrays behind a fixed header and are
+// copied into the vectors of the PreprocCircuit when loading. The file is
+// bound to the circuit through LevelOrderedCircuit::fingerprint(). P0 does
+// not need any preprocessing online and only stores the header.
+//
+// Preprocessing must not be used twice, as reusing masks and triples leaks
+// the values they protect. Loading therefore marks the file as consumed in
+// its header, and a consumed file is rejected.
+//
+// Layout (native byte order):
+//   header: magic, version, party id, fingerprint, number of levels,
+//           number of shuffle ids, number of input gates, note length,
+//           flags (balanced dealer, consumed)
+//   note (opaque string, e.g., statistics of the offline run)
+//   input pids                      (int32 per input gate at level 0)
+//   level seeds                     (16 bytes per level)
+//   level correction sizes          (uint64 per level)
+//   permutation seeds               (16 bytes per shuffle id)
+//   permutation correction sizes    (uint64 per shuffle id)
+//   level corrections               (concatenated)
+//   permutation corrections         (concatenated)
+
+// Writes preproc, which must be seed-compressed for P1 and P2.
+void savePreproc(const std::string& path, int id, const common::utils::LevelOrderedCircuit& circ,
+                 const PreprocCircuit<Ring>& preproc, const std::string& note = "");
+
+// Loads preprocessing written by savePreproc for the same party and circuit
+// and marks the file as consumed. The result is seed-compressed, unless
+// expand is set. Throws if the file does not exist, is malformed, was already
+// consumed, or belongs to another party or circuit.
+PreprocCircuit<Ring> loadPreproc(const std::string& path, int id, const common::utils::LevelOrderedCircuit& circ,
+                                 bool expand, std::string* note = nullptr);
+
+};
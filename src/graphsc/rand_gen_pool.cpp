@@ -20,6 +20,16 @@ namespace graphsc {
   k_12.reseed(&seed_block, 0);
 }
 
+RandGenPool::RandGenPool(int my_id, const emp::block& seed_01, const emp::block& seed_02)
+    : id_{my_id} {
+  auto seed_block = emp::makeBlock(0, 0);
+  k_self.reseed(&seed_block, 0);
+  k_all.reseed(&seed_block, 0);
+  k_12.reseed(&seed_block, 0);
+  k_01.reseed(&seed_01, 0);
+  k_02.reseed(&seed_02, 0);
+}
+
 emp::PRG& RandGenPool::self() { return k_self; }
 emp::PRG& RandGenPool::all() { return k_all; }
 
@@ -27,4 +37,30 @@ emp::PRG& RandGenPool::p01() { return k_01; }
 emp::PRG& RandGenPool::p02() { return k_02; }
 emp::PRG& RandGenPool::p12() { return k_12; }
 
+// emp::PRG::random_data takes an int length, so large requests are split.
+static const size_t MAX_DRAW = 1 << 24;
+
+void randomPermutation(emp::PRG& prg, size_t n, std::vector<Ring>& perm) {
+  perm.resize(n);
+  for (size_t j = 0; j < n; j++)
+    perm[j] = j;
+  std::vector<std::size_t> rand(std::min(n, MAX_DRAW));
+  for (size_t start = 0; start < n; start += MAX_DRAW) {
+    size_t len = std::min(n - start, MAX_DRAW);
+    prg.random_data(rand.data(), len * sizeof(std::size_t));
+    for (size_t j = start; j < start + len; j++) {
+      std::size_t k = rand[j - start] % (n - j);
+      std::swap(perm[j], perm[k + j]);
+    }
+  }
+}
+
+void randomRingElements(emp::PRG& prg, size_t n, std::vector<Ring>& data) {
+  data.resize(n);
+  for (size_t start = 0; start < n; start += MAX_DRAW) {
+    size_t len = std::min(n - start, MAX_DRAW);
+    prg.random_data(data.data() + start, len * sizeof(Ring));
+  }
+}
+
 }  // namespace asterisk
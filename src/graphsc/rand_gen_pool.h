@@ -24,6 +24,10 @@ class RandGenPool {
 
  public:
   explicit RandGenPool(int my_id, int num_parties, uint64_t seeds_high[5], uint64_t seeds_low[5]);
+  // Pool whose pairwise PRGs k_01 and k_02 are seeded with the given blocks,
+  // e.g., to derive one independent stream per circuit level. The remaining
+  // PRGs are seeded with zero and must not be used.
+  RandGenPool(int my_id, const emp::block& seed_01, const emp::block& seed_02);
   
   emp::PRG& self();// { return k_self; }
   emp::PRG& all();//{ return k_all; }
@@ -32,4 +36,11 @@ class RandGenPool {
   emp::PRG& p12();// { return k_p0; }
 };
 
+// Fills perm with a uniformly random permutation of 0, ..., n-1 (Fisher-Yates).
+// Parties holding the same PRG obtain the same permutation.
+void randomPermutation(emp::PRG& prg, size_t n, std::vector<Ring>& perm);
+
+// Fills data with n random ring elements, drawn in bulk.
+void randomRingElements(emp::PRG& prg, size_t n, std::vector<Ring>& data);
+
 };  // namespace asterisk
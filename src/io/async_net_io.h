@@ -0,0 +1,354 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "striped_net_io.h"
+#include "tls_net_io_channel.h"
+
+namespace io {
+using namespace emp;
+
+// Completion handle of an asynchronous send or receive. The buffer of the
+// transfer must stay valid until wait() returned or done() is true.
+class AsyncTransfer {
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  size_t pending_;
+  std::exception_ptr error_;
+
+  friend class AsyncNetEngine;
+
+  void partDone(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (error && !error_) {
+      error_ = error;
+    }
+    if (--pending_ == 0) {
+      cv_.notify_all();
+    }
+  }
+
+ public:
+  explicit AsyncTransfer(size_t parts) : pending_(parts) {}
+
+  bool done() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return pending_ == 0;
+  }
+
+  // Blocks until the transfer completed, rethrows if it failed.
+  void wait() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock, [&] { return pending_ == 0; });
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+};
+
+using AsyncHandle = std::shared_ptr<AsyncTransfer>;
+
+// Event loop that progresses asynchronous transfers on TLS connections.
+//
+// Transfers are queued per connection and processed in order, so any number
+// of them may be in flight on a channel. A single thread waits on all
+// connections with epoll. While a connection has queued transfers, its socket
+// is non-blocking and OpenSSL's retry signals decide whether the loop waits
+// for the socket to become readable or writable. Once the queue is empty, the
+// socket is switched back to blocking mode, so that the blocking calls of
+// NetIOMP can be used again after waitIdle(). Sends are flushed when they
+// complete, i.e., a completed send has been handed to the kernel.
+//
+// Transfers on the same channel must be submitted from one thread at a time,
+// just as for the blocking calls.
+class AsyncNetEngine {
+  struct Op {
+    AsyncHandle transfer;
+    char* buf;
+    size_t len;
+    bool send;
+    size_t done = 0;
+  };
+
+  struct Conn {
+    TLSNetIO* io;
+    std::deque<Op> ops;
+    uint32_t events = 0;
+  };
+
+  int epfd_ = -1;
+  int wakefd_ = -1;
+
+  std::mutex mtx_;
+  std::condition_variable idle_cv_;
+  // Submitted, but not yet taken over by the loop
+  std::vector<std::pair<TLSNetIO*, Op>> incoming_;
+  // Queued operations per connection, for waitIdle()
+  std::unordered_map<TLSNetIO*, size_t> in_flight_;
+  std::atomic<size_t> total_in_flight_{0};
+  bool stop_ = false;
+
+  // Only accessed by the loop thread
+  std::unordered_map<int, Conn> conns_;
+
+  // Last, so that it starts after the other members are initialized
+  std::thread thread_;
+
+  static void setBlocking(int fd, bool blocking) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+  }
+
+  // Returns the epoll events to wait for if bio asks for a retry, throws otherwise.
+  static uint32_t retryEvents(BIO* bio, const char* what) {
+    if (!BIO_should_retry(bio)) {
+      throw std::runtime_error(what);
+    }
+    return BIO_should_read(bio) ? EPOLLIN : EPOLLOUT;
+  }
+
+  // Makes as much progress on op as possible. Returns 0 when it is complete,
+  // otherwise the events to wait for.
+  static uint32_t step(TLSNetIO* io, Op& op) {
+    BIO* bio = io->buf_bio;
+    while (op.done < op.len) {
+      int chunk = static_cast<int>(std::min<size_t>(op.len - op.done, INT_MAX));
+      int res = op.send ? BIO_write(bio, op.buf + op.done, chunk) : BIO_read(bio, op.buf + op.done, chunk);
+      if (res > 0) {
+        op.done += res;
+      } else {
+        return retryEvents(bio, op.send ? "Asynchronous send failed" : "Asynchronous receive failed");
+      }
+    }
+    if (op.send && BIO_flush(bio) <= 0) {
+      return retryEvents(bio, "Asynchronous send failed");
+    }
+    return 0;
+  }
+
+  void finishOp(Conn& conn, std::exception_ptr error) {
+    auto transfer = std::move(conn.ops.front().transfer);
+    conn.ops.pop_front();
+    if (conn.ops.empty()) {
+      epoll_ctl(epfd_, EPOLL_CTL_DEL, conn.io->consocket, nullptr);
+      conn.events = 0;
+      setBlocking(conn.io->consocket, true);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      in_flight_[conn.io]--;
+      total_in_flight_--;
+    }
+    idle_cv_.notify_all();
+    transfer->partDone(error);
+  }
+
+  void progress(Conn& conn) {
+    while (!conn.ops.empty()) {
+      uint32_t events;
+      try {
+        events = step(conn.io, conn.ops.front());
+      } catch (...) {
+        // The byte stream of the connection is broken, fail everything queued on it
+        auto error = std::current_exception();
+        while (!conn.ops.empty()) {
+          finishOp(conn, error);
+        }
+        return;
+      }
+      if (events != 0) {
+        if (events != conn.events) {
+          epoll_event ev{};
+          ev.events = events;
+          ev.data.fd = conn.io->consocket;
+          epoll_ctl(epfd_, conn.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, conn.io->consocket, &ev);
+          conn.events = events;
+        }
+        return;
+      }
+      finishOp(conn, nullptr);
+    }
+  }
+
+  void failAll(std::exception_ptr error) {
+    for (auto& [fd, conn] : conns_) {
+      while (!conn.ops.empty()) {
+        finishOp(conn, error);
+      }
+    }
+  }
+
+  void loop() {
+    std::vector<epoll_event> events(64);
+    while (true) {
+      int num = epoll_wait(epfd_, events.data(), events.size(), -1);
+      bool failed = num < 0 && errno != EINTR;
+
+      std::vector<int> ready;
+      for (int i = 0; i < num; ++i) {
+        if (events[i].data.fd == wakefd_) {
+          uint64_t tmp;
+          [[maybe_unused]] auto res = read(wakefd_, &tmp, sizeof(tmp));
+        } else {
+          ready.push_back(events[i].data.fd);
+        }
+      }
+
+      std::vector<std::pair<TLSNetIO*, Op>> incoming;
+      bool stop;
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        incoming.swap(incoming_);
+        stop = stop_;
+      }
+      for (auto& [io, op] : incoming) {
+        auto& conn = conns_.try_emplace(io->consocket, Conn{io, {}, 0}).first->second;
+        if (conn.ops.empty()) {
+          setBlocking(io->consocket, false);
+          // Retrying a write after a partial TLS record may pass a different pointer
+          if (io->ssl != nullptr) {
+            SSL_set_mode(io->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+          }
+          ready.push_back(io->consocket);
+        }
+        conn.ops.push_back(std::move(op));
+      }
+
+      if (stop || failed) {
+        // Exceptions must not leave this thread, report them through the transfers
+        auto error = std::make_exception_ptr(std::runtime_error(
+            failed ? "epoll_wait failed" : "Network closed with pending transfers"));
+        failAll(error);
+        if (stop) {
+          return;
+        }
+        continue;
+      }
+
+      std::sort(ready.begin(), ready.end());
+      ready.erase(std::unique(ready.begin(), ready.end()), ready.end());
+      for (int fd : ready) {
+        progress(conns_.at(fd));
+      }
+    }
+  }
+
+  void wake() {
+    uint64_t one = 1;
+    [[maybe_unused]] auto res = write(wakefd_, &one, sizeof(one));
+  }
+
+  AsyncHandle submit(StripedTLSNetIO* channel, char* data, size_t len, bool send) {
+    auto parts = send ? channel->reserveSend(len) : channel->reserveRecv(len);
+    auto transfer = std::make_shared<AsyncTransfer>(parts.size());
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      for (const auto& part : parts) {
+        incoming_.push_back({part.stream, Op{transfer, data + part.offset, part.len, send}});
+        in_flight_[part.stream]++;
+        total_in_flight_++;
+      }
+    }
+    wake();
+    return transfer;
+  }
+
+  bool idle(StripedTLSNetIO* channel) {
+    for (size_t s = 0; s < channel->numStreams(); ++s) {
+      auto it = in_flight_.find(channel->stream(s));
+      if (it != in_flight_.end() && it->second != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ public:
+  AsyncNetEngine() {
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakefd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epfd_ < 0 || wakefd_ < 0) {
+      throw std::runtime_error("Could not set up the asynchronous network engine");
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakefd_;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, wakefd_, &ev);
+    thread_ = std::thread(&AsyncNetEngine::loop, this);
+  }
+
+  ~AsyncNetEngine() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stop_ = true;
+    }
+    wake();
+    thread_.join();
+    close(wakefd_);
+    close(epfd_);
+  }
+
+  AsyncNetEngine(const AsyncNetEngine&) = delete;
+  AsyncNetEngine& operator=(const AsyncNetEngine&) = delete;
+
+  // Queues sending len bytes of data on channel. Data sent with the blocking
+  // calls before is flushed first.
+  AsyncHandle send(StripedTLSNetIO* channel, const void* data, size_t len) {
+    if (len == 0) {
+      return std::make_shared<AsyncTransfer>(0);
+    }
+    flushIdle(channel);
+    channel->counter += len;
+    return submit(channel, static_cast<char*>(const_cast<void*>(data)), len, true);
+  }
+
+  // Queues receiving len bytes into data from channel.
+  AsyncHandle recv(StripedTLSNetIO* channel, void* data, size_t len) {
+    if (len == 0) {
+      return std::make_shared<AsyncTransfer>(0);
+    }
+    return submit(channel, static_cast<char*>(data), len, false);
+  }
+
+  // Flushes what the blocking calls buffered on channel. If transfers are
+  // queued on it, this already happened when the first of them was queued.
+  void flushIdle(StripedTLSNetIO* channel) {
+    bool was_idle;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      was_idle = idle(channel);
+    }
+    if (was_idle) {
+      // Still in blocking mode, and only the calling thread uses the channel
+      channel->flush();
+    }
+  }
+
+  // Blocks until no transfer is queued on channel anymore.
+  void waitIdle(StripedTLSNetIO* channel) {
+    if (total_in_flight_ == 0) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mtx_);
+    idle_cv_.wait(lock, [&] { return idle(channel); });
+  }
+};
+
+};  // namespace io
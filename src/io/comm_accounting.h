@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace io {
+
+// What communication is attributed to: the phase of the protocol, the level
+// of the circuit (-1 if not specific to one) and the gate type, e.g.,
+// {"online", 3, "Shuffle a vector"}.
+struct CommTag {
+  std::string phase;
+  int64_t level = -1;
+  std::string gate;
+
+  bool operator<(const CommTag& rhs) const {
+    return std::tie(phase, level, gate) < std::tie(rhs.phase, rhs.level, rhs.gate);
+  }
+};
+
+struct CommCount {
+  uint64_t bytes = 0;
+  // Times the party waited for an answer to what it sent
+  uint64_t rounds = 0;
+};
+
+// Part of a message that belongs to one tag, see CommAccounting::setShares.
+struct CommShare {
+  CommTag tag;
+  uint64_t bytes;
+};
+
+// Attributes the bytes a party sends and its round trips to tags, so that
+// changes in communication can be traced back to gate types and levels.
+//
+// Messages often combine the values of several gates, e.g., all
+// multiplications and shuffles of a level. Their bytes are split among the
+// tags of the gates by setShares, in the order the values are sent.
+class CommAccounting {
+  CommTag tag_{"untagged", -1, ""};
+  // Remaining bytes of each share, the first ones may already be used up
+  std::vector<CommShare> shares_;
+  size_t next_ = 0;
+  std::map<CommTag, CommCount> counts_;
+
+ public:
+  // Attributes everything from now on to tag.
+  void setTag(CommTag tag) {
+    tag_ = std::move(tag);
+    shares_.clear();
+    next_ = 0;
+  }
+
+  // Attributes the next bytes to the shares in order, and bytes beyond their
+  // sum to tag. Round trips until the next call count for all of them.
+  void setShares(CommTag tag, std::vector<CommShare> shares) {
+    setTag(std::move(tag));
+    shares_ = std::move(shares);
+  }
+
+  void addBytes(uint64_t bytes) {
+    for (; bytes > 0 && next_ < shares_.size(); ++next_) {
+      auto& share = shares_[next_];
+      uint64_t taken = std::min(bytes, share.bytes);
+      counts_[share.tag].bytes += taken;
+      share.bytes -= taken;
+      bytes -= taken;
+      if (share.bytes > 0) {
+        break;
+      }
+    }
+    if (bytes > 0) {
+      counts_[tag_].bytes += bytes;
+    }
+  }
+
+  // Every gate of a combined message waits for the round trip, so it is
+  // counted once for each tag of the shares.
+  void addRound() {
+    if (shares_.empty()) {
+      counts_[tag_].rounds++;
+      return;
+    }
+    std::set<CommTag> tags;
+    for (const auto& share : shares_) {
+      if (tags.insert(share.tag).second) {
+        counts_[share.tag].rounds++;
+      }
+    }
+  }
+
+  const std::map<CommTag, CommCount>& counts() const { return counts_; }
+};
+
+};  // namespace io
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace io {
+
+// Point in time at which establishing a connection is given up, or none for
+// waiting as long as it takes.
+class Deadline {
+  using Clock = std::chrono::steady_clock;
+
+  bool bounded_;
+  double seconds_;
+  Clock::time_point end_;
+
+ public:
+  // seconds <= 0 means no limit
+  explicit Deadline(double seconds)
+      : bounded_(seconds > 0),
+        seconds_(seconds),
+        end_(Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds))) {}
+
+  // The time limit for error messages, e.g., "2.5 s"
+  std::string describe() const {
+    std::ostringstream out;
+    out << seconds_ << " s";
+    return out.str();
+  }
+
+  bool expired() const { return bounded_ && Clock::now() >= end_; }
+
+  // Timeout for poll: milliseconds left, rounded up, or -1 without limit
+  int pollTimeout() const {
+    if (!bounded_) {
+      return -1;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(end_ - Clock::now()).count() + 1;
+    return static_cast<int>(std::max<long long>(left, 0));
+  }
+
+  // Waits until fd is readable, e.g., a listening socket has a connection to
+  // accept. Returns false if the deadline passed before.
+  bool waitReadable(int fd) const { return waitFor(fd, POLLIN); }
+
+  // connect() that gives up at the deadline even if the other host does not
+  // answer at all. Returns 0 on success and the error otherwise.
+  int connect(int fd, const sockaddr* addr, socklen_t len) const {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int err = 0;
+    if (::connect(fd, addr, len) != 0) {
+      err = errno;
+      if (err == EINPROGRESS) {
+        err = ETIMEDOUT;
+        if (waitFor(fd, POLLOUT)) {
+          socklen_t err_len = sizeof(err);
+          getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+        }
+      }
+    }
+    fcntl(fd, F_SETFL, flags);
+    return err;
+  }
+
+  // Connecting fails right away while the other party is not listening yet,
+  // and there is no way to be told when it is. Waits before the next attempt,
+  // twice as long every time up to 100 ms, so that a party starting later
+  // is found quickly without busy waiting.
+  void backoff(int& delay_us) const {
+    auto delay = std::chrono::microseconds(delay_us);
+    if (bounded_) {
+      delay = std::min(delay, std::chrono::duration_cast<std::chrono::microseconds>(end_ - Clock::now()));
+    }
+    if (delay.count() > 0) {
+      std::this_thread::sleep_for(delay);
+    }
+    delay_us = std::min(2 * delay_us, 100 * 1000);
+  }
+
+  // Makes blocking reads and writes on fd, e.g., of a TLS handshake, fail
+  // with EAGAIN at the deadline. clearTimeouts undoes this.
+  void applyTimeouts(int fd) const {
+    if (!bounded_) {
+      return;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(end_ - Clock::now()).count();
+    // Zero would disable the timeout
+    left = std::max<long long>(left, 1);
+    timeval tv{static_cast<time_t>(left / 1000000), static_cast<suseconds_t>(left % 1000000)};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+
+  static void clearTimeouts(int fd) {
+    timeval tv{0, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+
+ private:
+  bool waitFor(int fd, short events) const {
+    pollfd pfd{fd, events, 0};
+    while (true) {
+      int res = poll(&pfd, 1, pollTimeout());
+      if (res > 0) {
+        return true;
+      }
+      if (res == 0 || errno != EINTR) {
+        return false;
+      }
+    }
+  }
+};
+
+};  // namespace io
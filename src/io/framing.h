@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+namespace io {
+
+// Chooses the segment size for bulk transfers to one party from measurements
+// of earlier segments, replacing fixed segment sizes that only suit either a
+// LAN or a WAN.
+//
+// Each segment costs a fixed time plus its size divided by the throughput.
+// For an exchange, where both parties wait for the segment of the other, the
+// fixed time is about the latency of the link. Segments of a few
+// bandwidth-delay products thus keep the fixed overhead small, while larger
+// ones only take more memory in the channels. Until both values were
+// measured, the size doubles with every segment, starting small.
+class AdaptiveFraming {
+  // Segments in flight are at most this large unless limited further
+  static constexpr size_t DEFAULT_MAX_SEGMENT = 16 << 20;
+  // Segment size in bandwidth-delay products, i.e., the latency is at most
+  // a fifth of the time of a segment
+  static constexpr double TARGET_BDP = 4;
+  // Weight of a new throughput measurement
+  static constexpr double SMOOTHING = 0.25;
+
+  size_t max_segment_;
+  size_t segment_ = MIN_SEGMENT;
+  // Shortest segment time seen, taken as the fixed time per segment, and
+  // smoothed throughput in bytes per second. Zero while unknown.
+  double latency_ = 0;
+  double throughput_ = 0;
+
+ public:
+  // Segments are never smaller, except at the end of a transfer
+  static constexpr size_t MIN_SEGMENT = 1 << 16;
+
+  explicit AdaptiveFraming(size_t max_segment = DEFAULT_MAX_SEGMENT)
+      : max_segment_(std::max(max_segment, MIN_SEGMENT)) {}
+
+  // Size in bytes for the next segment.
+  size_t segmentSize() const { return segment_; }
+
+  double latency() const { return latency_; }
+  double throughput() const { return throughput_; }
+
+  // Takes into account that a segment of bytes took seconds, e.g., from
+  // sending its first byte until the segment of the other party was received.
+  void record(size_t bytes, double seconds) {
+    if (seconds <= 0) {
+      return;
+    }
+    if (latency_ == 0 || seconds < latency_) {
+      latency_ = seconds;
+    }
+    // Small segments, or segments not much slower than the latency, say little
+    // about the throughput
+    if (bytes >= MIN_SEGMENT && seconds > 2 * latency_) {
+      double measured = static_cast<double>(bytes) / (seconds - latency_);
+      throughput_ = throughput_ == 0 ? measured : SMOOTHING * measured + (1 - SMOOTHING) * throughput_;
+    }
+
+    double target = TARGET_BDP * latency_ * throughput_;
+    if (throughput_ == 0) {
+      // Only a full segment shows that larger ones would have been used
+      target = bytes >= segment_ ? 2.0 * static_cast<double>(segment_) : static_cast<double>(segment_);
+    }
+    segment_ = static_cast<size_t>(
+        std::clamp(target, static_cast<double>(MIN_SEGMENT), static_cast<double>(max_segment_)));
+  }
+};
+
+};  // namespace io
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+#include "emp-tool/io/io_channel.h"
+
+namespace io {
+using namespace emp;
+
+// Byte stream between two parties, as used by NetIOMP for each pair of
+// parties and direction. Implemented by the different transports (see
+// StripedTLSNetIO and ShmNetIO).
+//
+// As for the channels of emp, send_data counts the bytes sent, data arrives
+// in the order it was sent, and sent data may be buffered until flush().
+class NetChannel : public IOChannel<NetChannel> {
+ public:
+  virtual ~NetChannel() = default;
+
+  virtual void send_data_internal(const void* data, size_t len) = 0;
+  virtual void recv_data_internal(void* data, size_t len) = 0;
+  virtual void flush() = 0;
+  // Returns once the other end called sync() as well.
+  virtual void sync() = 0;
+};
+
+};  // namespace io
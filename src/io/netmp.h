@@ -29,63 +29,192 @@
 
 #include <emp-tool/emp-tool.h>
 #include "../utils/types.h"
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <vector>
+#include "async_net_io.h"
+#include "comm_accounting.h"
+#include "framing.h"
+#include "net_channel.h"
+#include "shm_net_io.h"
+#include "striped_net_io.h"
 #include "tls_net_io_channel.h"
+#include "wan_net_io.h"
 
 namespace io {
 using namespace emp;
 using namespace common::utils;
 
+// Connections between the parties. kTCP is neither encrypted nor
+// authenticated and only meant for trusted networks, e.g., an encrypted
+// overlay network, and for measuring the cost of TLS. kShm connects parties
+// on the same host through shared memory (see ShmNetIO).
+enum Transport { kTLS, kTCP, kShm };
+
 class NetIOMP {
+  // Opens the connection for stream s of the pair (i, j), i < j, in direction dir
+  // (0 from i to j, 1 from j to i). Stream 0 uses the same ports as before striping.
+  std::unique_ptr<TLSNetIO> connect(int i, int j, int s, int dir, int port, char* IP[], const std::string& certificate_path,
+                                    const std::string& private_key_path, const std::string& trusted_cert_path,
+                                    bool localhost, bool ktls, Transport transport, double timeout) {
+    bool tls = transport == kTLS;
+    int stream_port = port + 2 * (i * nP + j) + dir + 2 * nP * nP * s;
+    // i is the client for its sending connection, j for its own
+    bool client = (party == i) == (dir == 0);
+    int remote = party == i ? j : i;
+    std::unique_ptr<TLSNetIO> io;
+    if (client) {
+      io = std::make_unique<TLSNetIO>(localhost ? "127.0.0.1" : IP[remote], stream_port, trusted_cert_path, true, ktls, tls,
+                                      timeout);
+    } else {
+      io = std::make_unique<TLSNetIO>(stream_port, certificate_path, private_key_path, true, ktls, tls, timeout);
+    }
+    io->set_nodelay();
+    return io;
+  }
+
+  // Shared-memory channel of the pair (i, j) in direction dir, named after the
+  // port of the corresponding TCP connection. Created by the side that would
+  // accept the connection, so channels are set up in the same order.
+  std::unique_ptr<NetChannel> connectShm(int i, int j, int dir, int port, double timeout) {
+    int channel_port = port + 2 * (i * nP + j) + dir;
+    bool client = (party == i) == (dir == 0);
+    return std::make_unique<ShmNetIO>(std::to_string(channel_port), !client, timeout);
+  }
+
+  // The asynchronous backend only runs on socket channels, enableAsync() checks this.
+  static StripedTLSNetIO* socketChannel(NetChannel* channel) { return static_cast<StripedTLSNetIO*>(channel); }
+
  public:
-  std::vector<std::unique_ptr<TLSNetIO>> ios;
-  std::vector<std::unique_ptr<TLSNetIO>> ios2;
+  std::vector<std::unique_ptr<NetChannel>> ios;
+  std::vector<std::unique_ptr<NetChannel>> ios2;
   int party;
   int nP;
-  std::vector<bool> sent;
+  // Not std::vector<bool>, so that threads using different parties do not share bits.
+  std::vector<char> sent;
+  // Progresses send_async/recv_async once enableAsync() was called, null otherwise.
+  // Declared after the channels, so it stops before they close.
+  std::unique_ptr<AsyncNetEngine> async;
+  // Segment sizes for the bulk transfers to each party
+  std::vector<AdaptiveFraming> framing;
+  // Sent bytes and round trips by tag, set by the evaluators
+  CommAccounting accounting;
+  // Whether something was sent to a party since the last receive from it,
+  // which then is a round trip
+  std::vector<char> awaiting;
 
+  // streams is the number of parallel TLS connections per pair of parties and
+  // direction, data is striped across them (see StripedTLSNetIO). ktls requests
+  // kernel TLS offload for all connections (see TLSNetIO). With kTCP, the
+  // certificates and ktls are not used. With kShm, only port is used, to name
+  // the channels, and all parties must run on this host.
+  //
+  // All connections are established concurrently, including their TLS
+  // handshakes, so starting up takes about one handshake however many
+  // connections there are. With a positive timeout, throws if not all
+  // connections were established after that many seconds, otherwise waits
+  // as long as it takes for the other parties.
   NetIOMP(int party, int nP, int port, char* IP[], std::string certificate_path, std::string private_key_path,
-          std::string trusted_cert_path, bool localhost)
-      : ios(nP), ios2(nP), party(party), nP(nP), sent(nP, false) {
+          std::string trusted_cert_path, bool localhost, int streams = 1, bool ktls = false, Transport transport = kTLS,
+          double timeout = 0)
+      : ios(nP), ios2(nP), party(party), nP(nP), sent(nP, false), framing(nP), awaiting(nP, false) {
+    if (streams < 1) {
+      throw std::invalid_argument("Number of streams per party pair must be positive");
+    }
+    if (transport == kShm && !localhost) {
+      throw std::invalid_argument("The shared-memory transport requires all parties on the same host");
+    }
+    // Connections of each channel, indexed by 2 * other party + dir
+    std::vector<std::vector<std::unique_ptr<TLSNetIO>>> conns(2 * nP);
+    std::vector<std::thread> workers;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto run = [&](std::function<void()> task) {
+      workers.emplace_back([&error_mutex, &error, task]() {
+        try {
+          task();
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+      });
+    };
     for (int i = 0; i < nP; ++i) {
       for (int j = i + 1; j < nP; ++j) {
-        if (i == party) {
-          usleep(1000);
-          if (localhost) {
-            ios[j] = std::make_unique<TLSNetIO>("127.0.0.1", port + 2 * (i * nP + j), trusted_cert_path, true);
-          } else {
-            ios[j] = std::make_unique<TLSNetIO>(IP[j], port + 2 * (i * nP +j), trusted_cert_path, true);
-          }
-          ios[j]->set_nodelay();
-
-          usleep(1000);
-          if (localhost) {
-            ios2[j] = std::make_unique<TLSNetIO>(port + 2 * (i * nP + j) + 1, certificate_path, private_key_path, true);
-          } else {
-            ios2[j] = std::make_unique<TLSNetIO>(port + 2 * (i * nP +j) + 1, certificate_path, private_key_path, true);
+        if (i != party && j != party) {
+          continue;
+        }
+        int other = party == i ? j : i;
+        for (int dir = 0; dir < 2; ++dir) {
+          if (transport == kShm) {
+            auto* channel = &(dir == 0 ? ios : ios2)[other];
+            run([&, channel, i, j, dir]() { *channel = connectShm(i, j, dir, port, timeout); });
+            continue;
           }
-          ios2[j]->set_nodelay();
-        } else if (j == party) {
-          usleep(1000);
-          if (localhost) {
-            ios[i] = std::make_unique<TLSNetIO>(port + 2 * (i * nP + j), certificate_path, private_key_path, true);
-          } else {
-            ios[i] = std::make_unique<TLSNetIO>(port + 2 * (i * nP +j), certificate_path, private_key_path, true);
+          auto* channel_conns = &conns[2 * other + dir];
+          channel_conns->resize(streams);
+          for (int s = 0; s < streams; ++s) {
+            run([&, channel_conns, i, j, s, dir]() {
+              (*channel_conns)[s] = connect(i, j, s, dir, port, IP, certificate_path, private_key_path,
+                                            trusted_cert_path, localhost, ktls, transport, timeout);
+            });
           }
-          ios[i]->set_nodelay();
+        }
+      }
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
 
-          usleep(1000);
-          if (localhost) {
-            ios2[i] = std::make_unique<TLSNetIO>("127.0.0.1", port + 2 * (i * nP + j) + 1, trusted_cert_path, true);
-          } else {
-            ios2[i] = std::make_unique<TLSNetIO>(IP[i], port + 2 * (i * nP +j) + 1, trusted_cert_path, true);
-          }
-          ios2[i]->set_nodelay();
+    if (transport != kShm) {
+      for (int other = 0; other < nP; ++other) {
+        for (int dir = 0; dir < 2 && other != party; ++dir) {
+          (dir == 0 ? ios : ios2)[other] = std::make_unique<StripedTLSNetIO>(std::move(conns[2 * other + dir]));
         }
       }
     }
   }
 
+  // Starts the event loop for send_async/recv_async. Without it, all calls are
+  // blocking as before and no additional thread is running. Requires kTLS or
+  // kTCP connections and no emulateWan().
+  void enableAsync() {
+    for (int i = 0; i < nP; ++i) {
+      if (i != party && (dynamic_cast<StripedTLSNetIO*>(ios[i].get()) == nullptr ||
+                         dynamic_cast<StripedTLSNetIO*>(ios2[i].get()) == nullptr)) {
+        throw std::invalid_argument("The asynchronous network backend requires TLS or TCP connections without WAN emulation");
+      }
+    }
+    if (!async) {
+      async = std::make_unique<AsyncNetEngine>();
+    }
+  }
+
+  bool asyncEnabled() const { return async != nullptr; }
+
+  // Delays all data sent to the other parties as on a wide area network (see
+  // WanNetIO), separately for each pair of parties and direction. Cannot be
+  // combined with enableAsync().
+  void emulateWan(const WanProfile& profile) {
+    if (async) {
+      throw std::logic_error("WAN emulation cannot be combined with the asynchronous network backend");
+    }
+    for (int i = 0; i < nP; ++i) {
+      if (i != party) {
+        ios[i] = std::make_unique<WanNetIO>(std::move(ios[i]), profile);
+        ios2[i] = std::make_unique<WanNetIO>(std::move(ios2[i]), profile);
+      }
+    }
+  }
+
   int64_t count() {
     int64_t res = 0;
     for (int i = 0; i < nP; ++i)
@@ -107,11 +236,14 @@ class NetIOMP {
 
   void send(int dst, const void* data, size_t len) {
     if (dst != -1 and dst != party) {
+      if (async) async->waitIdle(socketChannel(getSendChannel(dst)));
       if (party < dst)
         ios[dst]->send_data(data, len);
       else
         ios2[dst]->send_data(data, len);
       sent[dst] = true;
+      awaiting[dst] = true;
+      accounting.addBytes(len);
     }
     #ifdef __clang__
         flush(dst);
@@ -160,6 +292,11 @@ class NetIOMP {
   void recv(int src, void* data, size_t len) {
     if (src != -1 && src != party) {
       if (sent[src]) flush(src);
+      if (awaiting[src]) {
+        accounting.addRound();
+        awaiting[src] = false;
+      }
+      if (async) async->waitIdle(socketChannel(getRecvChannel(src)));
       if (src < party)
         ios[src]->recv_data(data, len);
       else
@@ -167,6 +304,38 @@ class NetIOMP {
     }
   }
 
+  // Non-blocking variants of send and recv. Any number of transfers can be in
+  // flight per peer, they are processed in the order of submission and behind
+  // earlier blocking calls. The blocking calls wait for the queued transfers of
+  // their channel. data must stay valid until the returned handle completed.
+  // Requires enableAsync().
+  AsyncHandle send_async(int dst, const void* data, size_t len) {
+    if (!async) {
+      throw std::logic_error("send_async requires enableAsync()");
+    }
+    if (dst == -1 || dst == party) {
+      return std::make_shared<AsyncTransfer>(0);
+    }
+    awaiting[dst] = true;
+    accounting.addBytes(len);
+    return async->send(socketChannel(getSendChannel(dst)), data, len);
+  }
+
+  AsyncHandle recv_async(int src, void* data, size_t len) {
+    if (!async) {
+      throw std::logic_error("recv_async requires enableAsync()");
+    }
+    if (src == -1 || src == party) {
+      return std::make_shared<AsyncTransfer>(0);
+    }
+    if (sent[src]) async->flushIdle(socketChannel(getSendChannel(src)));
+    if (awaiting[src]) {
+      accounting.addRound();
+      awaiting[src] = false;
+    }
+    return async->recv(socketChannel(getRecvChannel(src)), data, len);
+  }
+
   void recv(int dst, NTL::ZZ_p* data, size_t length) {
     std::vector<uint8_t> serialized(length);
     recv(dst, serialized.data(), serialized.size());
@@ -205,14 +374,83 @@ class NetIOMP {
     recvBool(src, data, len);
   }
 
-  TLSNetIO* get(size_t idx, bool b = false) {
+  // Sends len bytes of send_data to other and receives len bytes from it into
+  // recv_data, which other does in turn. Large transfers are cut into segments
+  // chosen by framing[other]. Sending runs concurrently to receiving, so the
+  // exchange cannot deadlock however large the segments. With enableAsync(),
+  // the asynchronous backend transfers everything at once instead. Each
+  // segment counts as a round trip.
+  void exchange(int other, const void* send_data, void* recv_data, size_t len) {
+    if (async) {
+      auto sending = send_async(other, send_data, len);
+      auto receiving = recv_async(other, recv_data, len);
+      sending->wait();
+      receiving->wait();
+      return;
+    }
+
+    auto* send_channel = getSendChannel(other);
+    auto* recv_channel = getRecvChannel(other);
+    auto* send_bytes = static_cast<const char*>(send_data);
+    auto* recv_bytes = static_cast<char*>(recv_data);
+    for (size_t pos = 0; pos < len;) {
+      size_t segment = std::min(framing[other].segmentSize(), len - pos);
+      auto start = std::chrono::steady_clock::now();
+      if (segment <= AdaptiveFraming::MIN_SEGMENT) {
+        // Small enough for the buffers of any channel
+        accounting.addBytes(segment);
+        send_channel->send_data(send_bytes + pos, segment);
+        send_channel->flush();
+        recv_channel->recv_data(recv_bytes + pos, segment);
+      } else {
+        accounting.addBytes(segment);
+        std::exception_ptr error;
+        std::thread sender([&]() {
+          try {
+            send_channel->send_data(send_bytes + pos, segment);
+            send_channel->flush();
+          } catch (...) {
+            error = std::current_exception();
+          }
+        });
+        recv_channel->recv_data(recv_bytes + pos, segment);
+        sender.join();
+        if (error) {
+          std::rethrow_exception(error);
+        }
+      }
+      framing[other].record(segment, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+      accounting.addRound();
+      pos += segment;
+    }
+  }
+
+  // Sends len bytes to dst without expecting an answer, in segments chosen by
+  // framing[dst] from how long sending earlier segments took, so the receiver
+  // already gets the first segments while later ones are sent. The receiver
+  // may use recvBulk or recv alike.
+  void sendBulk(int dst, const void* data, size_t len) {
+    auto* bytes = static_cast<const char*>(data);
+    for (size_t pos = 0; pos < len;) {
+      size_t segment = std::min(framing[dst].segmentSize(), len - pos);
+      auto start = std::chrono::steady_clock::now();
+      send(dst, bytes + pos, segment);
+      flush(dst);
+      framing[dst].record(segment, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+      pos += segment;
+    }
+  }
+
+  void recvBulk(int src, void* data, size_t len) { recv(src, data, len); }
+
+  NetChannel* get(size_t idx, bool b = false) {
     if (b)
       return ios[idx].get();
     else
       return ios2[idx].get();
   }
 
-  TLSNetIO* getSendChannel(size_t idx) {
+  NetChannel* getSendChannel(size_t idx) {
     if ((size_t)party < idx) {
       return ios[idx].get();
     }
@@ -220,7 +458,7 @@ class NetIOMP {
     return ios2[idx].get();
   }
 
-  TLSNetIO* getRecvChannel(size_t idx) {
+  NetChannel* getRecvChannel(size_t idx) {
     if (idx < (size_t)party) {
       return ios[idx].get();
     }
@@ -228,14 +466,22 @@ class NetIOMP {
     return ios2[idx].get();
   }
 
+  // Queued asynchronous sends flush themselves, so this does not wait for them.
   void flush(int idx = -1) {
     if (idx == -1) {
       for (int i = 0; i < nP; ++i) {
         if (i != party) {
-          ios[i]->flush();
-          ios2[i]->flush();
+          if (async) {
+            async->flushIdle(socketChannel(ios[i].get()));
+            async->flushIdle(socketChannel(ios2[i].get()));
+          } else {
+            ios[i]->flush();
+            ios2[i]->flush();
+          }
         }
       }
+    } else if (async) {
+      async->flushIdle(socketChannel(getSendChannel(idx)));
     } else {
       if (party < idx) {
         ios[idx]->flush();
@@ -246,6 +492,12 @@ class NetIOMP {
   }
 
   void sync() {
+    for (int i = 0; async && i < nP; ++i) {
+      if (i != party) {
+        async->waitIdle(socketChannel(ios[i].get()));
+        async->waitIdle(socketChannel(ios2[i].get()));
+      }
+    }
     for (int i = 0; i < nP; ++i) {
       for (int j = 0; j < nP; ++j) {
         if (i < j) {
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "deadline.h"
+#include "net_channel.h"
+
+namespace io {
+
+// Channel between two parties on the same host through shared memory.
+//
+// Each direction is a ring buffer in a memfd mapping shared by both
+// processes. Data is copied into the ring and published with one atomic
+// store, so no system call is made while the other side keeps up. Only a
+// reader finding its ring empty, or a writer finding it full, sleeps on a
+// futex after spinning briefly, and is woken by the other side once it made
+// progress. Sent data is visible to the receiver right away, so flush() has
+// nothing to do.
+//
+// The creating side hands the memfd to the connecting side over an abstract
+// unix socket named after the channel. Such sockets disappear with their
+// process, so a crashed run leaves nothing behind.
+class ShmNetIO : public NetChannel {
+  // Shared state of one direction. The positions count all bytes ever
+  // written and read, so the ring is empty if they are equal and full if
+  // they differ by the capacity.
+  struct Ring {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    // Futex words, bumped to wake a reader waiting for data or a writer
+    // waiting for space
+    alignas(64) std::atomic<uint32_t> data_seq;
+    std::atomic<uint32_t> reader_waiting;
+    alignas(64) std::atomic<uint32_t> space_seq;
+    std::atomic<uint32_t> writer_waiting;
+    // Set when either side closes the channel
+    std::atomic<uint32_t> closed;
+  };
+  static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                "Shared-memory channels need address-free atomics");
+
+  // Checks per wait before sleeping on the futex
+  static constexpr int SPIN_ROUNDS = 1 << 12;
+
+  bool creator_;
+  size_t capacity_;
+  size_t map_size_ = 0;
+  void* map_ = MAP_FAILED;
+  Ring* out_ = nullptr;
+  Ring* in_ = nullptr;
+  char* out_data_ = nullptr;
+  char* in_data_ = nullptr;
+  pid_t peer_pid_ = 0;
+
+  static sockaddr_un address(const std::string& name, socklen_t& len) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::string path = "multicent-shm-" + name;
+    if (path.size() + 1 > sizeof(addr.sun_path)) {
+      throw std::invalid_argument("Name of shared-memory channel is too long");
+    }
+    // Leading null byte: abstract namespace
+    std::memcpy(addr.sun_path + 1, path.data(), path.size());
+    len = offsetof(sockaddr_un, sun_path) + 1 + path.size();
+    return addr;
+  }
+
+  static pid_t peerPid(int sock) {
+    ucred cred{};
+    socklen_t len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+      throw std::runtime_error("Could not identify the other end of a shared-memory channel");
+    }
+    return cred.pid;
+  }
+
+  void map(int fd) {
+    map_size_ = 2 * sizeof(Ring) + 2 * capacity_;
+    map_ = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map_ == MAP_FAILED) {
+      throw std::runtime_error("Could not map shared-memory channel");
+    }
+    auto* base = static_cast<char*>(map_);
+    // The creator writes ring 0 and reads ring 1
+    int out = creator_ ? 0 : 1;
+    out_ = reinterpret_cast<Ring*>(base + out * sizeof(Ring));
+    in_ = reinterpret_cast<Ring*>(base + (1 - out) * sizeof(Ring));
+    out_data_ = base + 2 * sizeof(Ring) + out * capacity_;
+    in_data_ = base + 2 * sizeof(Ring) + (1 - out) * capacity_;
+  }
+
+  void create(const std::string& name, const Deadline& deadline) {
+    int fd = memfd_create("multicent-shm", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, 2 * sizeof(Ring) + 2 * capacity_) != 0) {
+      throw std::runtime_error("Could not allocate shared-memory channel");
+    }
+    map(fd);
+    new (out_) Ring{};
+    new (in_) Ring{};
+
+    socklen_t len;
+    auto addr = address(name, len);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), len) != 0 || listen(listener, 1) != 0) {
+      throw std::runtime_error("Could not open shared-memory channel " + name + ", is it already in use?");
+    }
+    if (!deadline.waitReadable(listener)) {
+      close(listener);
+      close(fd);
+      throw std::runtime_error("No party opened shared-memory channel " + name + " within " +
+                               deadline.describe());
+    }
+    int conn = accept(listener, nullptr, nullptr);
+    close(listener);
+    if (conn < 0) {
+      throw std::runtime_error("Could not accept on shared-memory channel " + name);
+    }
+    peer_pid_ = peerPid(conn);
+
+    // Pass the memfd along with the capacity
+    uint64_t capacity = capacity_;
+    iovec iov{&capacity, sizeof(capacity)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    bool sent = sendmsg(conn, &msg, 0) == static_cast<ssize_t>(sizeof(capacity));
+    close(conn);
+    close(fd);
+    if (!sent) {
+      throw std::runtime_error("Could not hand over shared-memory channel " + name);
+    }
+  }
+
+  void open(const std::string& name, const Deadline& deadline) {
+    socklen_t len;
+    auto addr = address(name, len);
+    int conn;
+    int delay_us = 1000;
+    while (true) {
+      conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (deadline.connect(conn, reinterpret_cast<sockaddr*>(&addr), len) == 0) {
+        break;
+      }
+      close(conn);
+      if (deadline.expired()) {
+        throw std::runtime_error("No party created shared-memory channel " + name + " within " +
+                                 deadline.describe());
+      }
+      deadline.backoff(delay_us);
+    }
+    peer_pid_ = peerPid(conn);
+
+    uint64_t capacity = 0;
+    iovec iov{&capacity, sizeof(capacity)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t res = recvmsg(conn, &msg, MSG_WAITALL);
+    close(conn);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (res != static_cast<ssize_t>(sizeof(capacity)) || cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS) {
+      throw std::runtime_error("Did not receive shared-memory channel " + name);
+    }
+    int fd;
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    capacity_ = capacity;
+    map(fd);
+    close(fd);
+  }
+
+  static void futexWait(std::atomic<uint32_t>& word, uint32_t expected) {
+    // Wake up now and then to notice if the other process is gone
+    timespec timeout{0, 100 * 1000 * 1000};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+  }
+
+  static void futexWake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+  }
+
+  static void wake(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting) {
+    if (waiting.load() != 0) {
+      seq.fetch_add(1);
+      futexWake(seq);
+    }
+  }
+
+  // Blocks until ready() returns true. The counterpart of wake(): waiting is
+  // set before ready() is checked a last time, and the other side checks it
+  // after making progress, so either this side sees the progress or the other
+  // one sees it waiting.
+  template <class Ready>
+  void await(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting, Ready ready) {
+    for (int i = 0; i < SPIN_ROUNDS; ++i) {
+      if (ready()) {
+        return;
+      }
+    }
+    while (true) {
+      uint32_t expected = seq.load();
+      waiting.store(1);
+      if (ready()) {
+        waiting.store(0);
+        return;
+      }
+      futexWait(seq, expected);
+      waiting.store(0);
+      // The other process may have made progress right before exiting
+      if (kill(peer_pid_, 0) != 0 && errno == ESRCH && !ready()) {
+        throw std::runtime_error("Party at the other end of a shared-memory channel exited");
+      }
+    }
+  }
+
+ public:
+  // Per direction. Protocols send to each other before receiving, which only
+  // works while the data fits into the buffers of the channel, so this is not
+  // less than what loopback TCP buffers by default. Pages are only allocated
+  // once touched.
+  static constexpr size_t DEFAULT_CAPACITY = 32 * 1024 * 1024;
+
+  // Both ends use the same name, one of them creates the channel. The
+  // capacity of each direction is chosen by the creating side. With a
+  // positive timeout, throws if the other end did not show up after that
+  // many seconds.
+  ShmNetIO(const std::string& name, bool create_channel, double timeout = 0, size_t capacity = DEFAULT_CAPACITY)
+      : creator_(create_channel), capacity_(capacity) {
+    if (capacity_ == 0) {
+      throw std::invalid_argument("Capacity of a shared-memory channel must be positive");
+    }
+    Deadline deadline(timeout);
+    try {
+      if (creator_) {
+        create(name, deadline);
+      } else {
+        open(name, deadline);
+      }
+    } catch (...) {
+      if (map_ != MAP_FAILED) {
+        munmap(map_, map_size_);
+      }
+      throw;
+    }
+  }
+
+  ~ShmNetIO() override {
+    if (map_ == MAP_FAILED) {
+      return;
+    }
+    for (Ring* ring : {out_, in_}) {
+      ring->closed.store(1);
+      ring->data_seq.fetch_add(1);
+      futexWake(ring->data_seq);
+      ring->space_seq.fetch_add(1);
+      futexWake(ring->space_seq);
+    }
+    munmap(map_, map_size_);
+  }
+
+  ShmNetIO(const ShmNetIO&) = delete;
+  ShmNetIO& operator=(const ShmNetIO&) = delete;
+
+  void send_data_internal(const void* data, size_t len) override {
+    const char* src = static_cast<const char*>(data);
+    uint64_t head = out_->head.load(std::memory_order_relaxed);
+    while (len > 0) {
+      uint64_t tail = out_->tail.load(std::memory_order_acquire);
+      size_t space = capacity_ - (head - tail);
+      if (space == 0) {
+        await(out_->space_seq, out_->writer_waiting, [&] {
+          if (out_->closed.load() != 0) {
+            throw std::runtime_error("Shared-memory channel was closed by the other party");
+          }
+          return out_->tail.load() != tail;
+        });
+        continue;
+      }
+      size_t num = std::min(len, space);
+      size_t offset = head % capacity_;
+      size_t first = std::min(num, capacity_ - offset);
+      std::memcpy(out_data_ + offset, src, first);
+      std::memcpy(out_data_, src + first, num - first);
+      head += num;
+      out_->head.store(head);
+      wake(out_->data_seq, out_->reader_waiting);
+      src += num;
+      len -= num;
+    }
+  }
+
+  void recv_data_internal(void* data, size_t len) override {
+    char* dst = static_cast<char*>(data);
+    uint64_t tail = in_->tail.load(std::memory_order_relaxed);
+    while (len > 0) {
+      uint64_t head = in_->head.load(std::memory_order_acquire);
+      if (head == tail) {
+        await(in_->data_seq, in_->reader_waiting, [&] {
+          if (in_->head.load() != tail) {
+            return true;
+          }
+          if (in_->closed.load() != 0) {
+            throw std::runtime_error("Shared-memory channel was closed by the other party");
+          }
+          return false;
+        });
+        continue;
+      }
+      size_t num = std::min<uint64_t>(len, head - tail);
+      size_t offset = tail % capacity_;
+      size_t first = std::min(num, capacity_ - offset);
+      std::memcpy(dst, in_data_ + offset, first);
+      std::memcpy(dst + first, in_data_, num - first);
+      tail += num;
+      in_->tail.store(tail);
+      wake(in_->space_seq, in_->writer_waiting);
+      dst += num;
+      len -= num;
+    }
+  }
+
+  void flush() override {}
+
+  void sync() override {
+    char tmp = 0;
+    if (creator_) {
+      send_data_internal(&tmp, 1);
+      recv_data_internal(&tmp, 1);
+    } else {
+      recv_data_internal(&tmp, 1);
+      send_data_internal(&tmp, 1);
+    }
+  }
+};
+
+};  // namespace io
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "net_channel.h"
+#include "tls_net_io_channel.h"
+
+namespace io {
+using namespace emp;
+
+// Channel between two parties striped across several TLS connections.
+//
+// A single TLS-over-TCP stream is limited by the congestion window of one
+// connection and by the AES-GCM throughput of one core. This channel splits
+// the byte stream into blocks of fixed size and assigns block b to connection
+// b % K. Sender and receiver both track the position in the byte stream, so
+// data can be sent and received in chunks of any size, exactly as with a
+// single TLSNetIO. A send or receive covering blocks of several connections
+// is processed by one thread per connection in parallel.
+//
+// A connection is flushed whenever one of its blocks is complete. Only the
+// last, partial block is kept in a buffer until flush() is called, so a
+// receiver never waits for a block that is stuck in the buffer of another
+// connection.
+class StripedTLSNetIO : public NetChannel {
+  // Runs the transfers of one connection.
+  class StreamWorker {
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::function<void()> task_;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::exception_ptr error_;
+    // Last, so that it starts after the other members are initialized
+    std::thread thread_;
+
+    void loop() {
+      std::unique_lock<std::mutex> lock(mtx_);
+      while (true) {
+        cv_.wait(lock, [&] { return busy_ || stop_; });
+        if (stop_) {
+          return;
+        }
+        lock.unlock();
+        try {
+          task_();
+        } catch (...) {
+          error_ = std::current_exception();
+        }
+        lock.lock();
+        task_ = nullptr;
+        busy_ = false;
+        cv_.notify_all();
+      }
+    }
+
+   public:
+    StreamWorker() : thread_(&StreamWorker::loop, this) {}
+
+    ~StreamWorker() {
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+      }
+      cv_.notify_all();
+      thread_.join();
+    }
+
+    void start(std::function<void()> task) {
+      std::lock_guard<std::mutex> lock(mtx_);
+      task_ = std::move(task);
+      busy_ = true;
+      cv_.notify_all();
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cv_.wait(lock, [&] { return !busy_; });
+      if (error_) {
+        auto error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+      }
+    }
+  };
+
+  // Part of a transfer that lies within a single block.
+  struct Segment {
+    size_t offset;  // within the buffer of the transfer
+    size_t len;
+    bool ends_block;
+  };
+
+  std::vector<std::unique_ptr<TLSNetIO>> streams_;
+  std::vector<std::unique_ptr<StreamWorker>> workers_;
+  size_t block_size_;
+  // Position in the byte stream in each direction
+  uint64_t send_pos_ = 0;
+  uint64_t recv_pos_ = 0;
+  // Like TLSNetIO, data sent on this channel is flushed before receiving on it
+  bool has_sent_ = false;
+
+  // Splits a transfer of len bytes starting at pos into the segments of each connection.
+  std::vector<std::vector<Segment>> split(uint64_t pos, size_t len) const {
+    std::vector<std::vector<Segment>> segments(streams_.size());
+    size_t done = 0;
+    while (done < len) {
+      uint64_t block = pos / block_size_;
+      size_t in_block = pos % block_size_;
+      size_t seg_len = std::min(len - done, block_size_ - in_block);
+      segments[block % streams_.size()].push_back({done, seg_len, in_block + seg_len == block_size_});
+      done += seg_len;
+      pos += seg_len;
+    }
+    return segments;
+  }
+
+ public:
+  // Part of an asynchronous transfer that lies on one connection.
+  struct Part {
+    TLSNetIO* stream;
+    size_t offset;  // within the buffer of the transfer
+    size_t len;
+  };
+
+ private:
+  std::vector<Part> reserve(uint64_t& pos, size_t len) {
+    if (streams_.size() == 1) {
+      return {{streams_[0].get(), 0, len}};
+    }
+    auto segments = split(pos, len);
+    pos += len;
+    std::vector<Part> parts;
+    for (size_t s = 0; s < streams_.size(); ++s) {
+      for (const auto& seg : segments[s]) {
+        parts.push_back({streams_[s].get(), seg.offset, seg.len});
+      }
+    }
+    return parts;
+  }
+
+  // Runs job for every connection with segments, in parallel if there are several.
+  void forEachStream(const std::vector<std::vector<Segment>>& segments,
+                     const std::function<void(size_t, const std::vector<Segment>&)>& job) {
+    std::vector<size_t> active;
+    for (size_t s = 0; s < segments.size(); ++s) {
+      if (!segments[s].empty()) {
+        active.push_back(s);
+      }
+    }
+    if (active.size() == 1) {
+      job(active[0], segments[active[0]]);
+      return;
+    }
+    for (auto s : active) {
+      workers_[s]->start([&, s]() { job(s, segments[s]); });
+    }
+    for (auto s : active) {
+      workers_[s]->wait();
+    }
+  }
+
+ public:
+  // Default size of the blocks assigned to the connections in turn.
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+  explicit StripedTLSNetIO(std::vector<std::unique_ptr<TLSNetIO>> streams, size_t block_size = DEFAULT_BLOCK_SIZE)
+      : streams_(std::move(streams)), block_size_(block_size) {
+    if (streams_.empty()) {
+      throw std::invalid_argument("A striped channel needs at least one connection");
+    }
+    if (block_size_ == 0) {
+      throw std::invalid_argument("Block size of a striped channel must be positive");
+    }
+    if (streams_.size() > 1) {
+      for (size_t s = 0; s < streams_.size(); ++s) {
+        workers_.push_back(std::make_unique<StreamWorker>());
+      }
+    }
+  }
+
+  ~StripedTLSNetIO() override {
+    // Stop the workers before the connections flush and close
+    workers_.clear();
+  }
+
+  size_t numStreams() const { return streams_.size(); }
+
+  TLSNetIO* stream(size_t idx) { return streams_[idx].get(); }
+
+  // Reserve the next len bytes of the outgoing (incoming) byte stream for an
+  // asynchronous transfer (see AsyncNetEngine) and return its parts.
+  std::vector<Part> reserveSend(size_t len) { return reserve(send_pos_, len); }
+  std::vector<Part> reserveRecv(size_t len) { return reserve(recv_pos_, len); }
+
+  // Whether all connections offload sending (receiving) to kernel TLS.
+  bool ktlsSend() const {
+    return std::all_of(streams_.begin(), streams_.end(), [](const auto& stream) { return stream->ktls_send; });
+  }
+  bool ktlsRecv() const {
+    return std::all_of(streams_.begin(), streams_.end(), [](const auto& stream) { return stream->ktls_recv; });
+  }
+
+  void send_data_internal(const void* data, size_t len) override {
+    has_sent_ = true;
+    if (streams_.size() == 1) {
+      streams_[0]->send_data_internal(data, len);
+      return;
+    }
+    auto segments = split(send_pos_, len);
+    send_pos_ += len;
+    const char* buf = static_cast<const char*>(data);
+    forEachStream(segments, [&](size_t s, const std::vector<Segment>& segs) {
+      for (const auto& seg : segs) {
+        streams_[s]->send_data_internal(buf + seg.offset, seg.len);
+        if (seg.ends_block) {
+          streams_[s]->flush();
+        }
+      }
+    });
+  }
+
+  void recv_data_internal(void* data, size_t len) override {
+    if (has_sent_) {
+      flush();
+      has_sent_ = false;
+    }
+    if (streams_.size() == 1) {
+      streams_[0]->recv_data_internal(data, len);
+      return;
+    }
+    auto segments = split(recv_pos_, len);
+    recv_pos_ += len;
+    char* buf = static_cast<char*>(data);
+    forEachStream(segments, [&](size_t s, const std::vector<Segment>& segs) {
+      for (const auto& seg : segs) {
+        streams_[s]->recv_data_internal(buf + seg.offset, seg.len);
+      }
+    });
+  }
+
+  void flush() override {
+    for (auto& stream : streams_) {
+      stream->flush();
+    }
+  }
+
+  void sync() override {
+    // The partial blocks of all connections must be out before waiting on the first one
+    flush();
+    has_sent_ = false;
+    for (auto& stream : streams_) {
+      stream->sync();
+    }
+  }
+
+  void set_nodelay() {
+    for (auto& stream : streams_) {
+      stream->set_nodelay();
+    }
+  }
+
+  void set_delay() {
+    for (auto& stream : streams_) {
+      stream->set_delay();
+    }
+  }
+};
+
+};  // namespace io
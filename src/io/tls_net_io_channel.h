@@ -19,6 +19,8 @@ using std::string;
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
+#include "deadline.h"
+
 namespace emp {
 
 class TLSNetIO: public IOChannel<TLSNetIO> { public:
@@ -30,11 +32,25 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 	bool has_sent = false;
 	string addr;
 	int port;
-	SSL_CTX *ctx;
-	SSL *ssl;
+	// Both null for an unencrypted connection
+	SSL_CTX *ctx = nullptr;
+	SSL *ssl = nullptr;
 	BIO *buf_bio;
-
-	TLSNetIO(const char * address, int port, std::string trusted_cert_path, bool quiet = false) {
+	// Whether the kernel encrypts/decrypts the records of this connection (kTLS)
+	bool ktls_send = false;
+	bool ktls_recv = false;
+
+	// With ktls, record encryption is offloaded to the kernel if both the
+	// kernel and OpenSSL support it for the negotiated cipher, otherwise the
+	// connection silently falls back to encryption in user space.
+	// Without tls, the connection is plain TCP: neither encrypted nor
+	// authenticated, only meant for trusted networks and for measuring the
+	// cost of TLS. Certificates are not used then, and ktls is ignored.
+	// With a positive timeout, the constructor throws if the connection and
+	// handshake were not done after that many seconds, otherwise it waits as
+	// long as it takes for the other party.
+	TLSNetIO(const char * address, int port, std::string trusted_cert_path, bool quiet = false, bool ktls = false, bool tls = true,
+			double timeout = 0) {
 		if (port <0 || port > 65535) {
 			throw std::runtime_error("Invalid port number!");
 		}
@@ -43,16 +59,21 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 		is_server = false;
 
 		// client-specific
-		ctx = SSL_CTX_new(TLS_client_method());
-		if (ctx == nullptr) {
-			ERR_print_errors_fp(stderr);
-			exit(1);
-		}
+		if (tls) {
+			ctx = SSL_CTX_new(TLS_client_method());
+			if (ctx == nullptr) {
+				ERR_print_errors_fp(stderr);
+				exit(1);
+			}
 
-		SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
-		if (SSL_CTX_load_verify_file(ctx, trusted_cert_path.c_str()) <= 0) {
-			ERR_print_errors_fp(stderr);
-			exit(1);
+			SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+			if (ktls) {
+				enable_ktls();
+			}
+			if (SSL_CTX_load_verify_file(ctx, trusted_cert_path.c_str()) <= 0) {
+				ERR_print_errors_fp(stderr);
+				exit(1);
+			}
 		}
 
 		addr = string(address);
@@ -63,15 +84,30 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 		dest.sin_addr.s_addr = inet_addr(address);
 		dest.sin_port = htons(port);
 
+		io::Deadline deadline(timeout);
+		int delay_us = 1000;
 		while(1) {
 			consocket = socket(AF_INET, SOCK_STREAM, 0);
 
-			if (connect(consocket, (struct sockaddr *)&dest, sizeof(struct sockaddr)) == 0) {
+			int err = deadline.connect(consocket, (struct sockaddr *)&dest, sizeof(struct sockaddr));
+			if (err == 0) {
 				break;
 			}
 
 			close(consocket);
-			usleep(1000);
+			if (err != ECONNREFUSED && err != ETIMEDOUT && err != ECONNRESET && err != ENETUNREACH && err != EHOSTUNREACH && err != EINTR) {
+				throw std::runtime_error("Could not connect to " + addr + ":" + std::to_string(port) + ": " + strerror(err));
+			}
+			if (deadline.expired()) {
+				throw std::runtime_error("No party accepted connections at " + addr + ":" + std::to_string(port) + " within " +
+				                         deadline.describe());
+			}
+			deadline.backoff(delay_us);
+		}
+
+		if (!tls) {
+			init_plain(quiet);
+			return;
 		}
 
 		// wrap consocket in BIO
@@ -91,11 +127,18 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 		// SSL_set_bio(ssl, raw_bio, raw_bio);
 
 		// perform handshake
+		deadline.applyTimeouts(consocket);
 		if (SSL_connect(ssl) <= 0) {
 			ERR_print_errors_fp(stderr);
 			SSL_free(ssl);
+			if (deadline.expired()) {
+				throw std::runtime_error("SSL handshake with " + addr + ":" + std::to_string(port) + " timed out");
+			}
                         throw std::runtime_error("Error performing SSL handshake with server");
 		}
+		io::Deadline::clearTimeouts(consocket);
+
+		check_ktls();
 
 		// wrap SSL in BIO
 		BIO *ssl_bio = BIO_new(BIO_f_ssl());
@@ -116,7 +159,8 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 			std::cout << "connected\n";
 	}
 
-	TLSNetIO(int port, std::string certificate_chain_file, std::string private_key_file, bool quiet = false) {
+	TLSNetIO(int port, std::string certificate_chain_file, std::string private_key_file, bool quiet = false, bool ktls = false, bool tls = true,
+			double timeout = 0) {
 		if (port <0 || port > 65535) {
 			throw std::runtime_error("Invalid port number!");
 		}
@@ -125,27 +169,32 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 		is_server = true;
 
 		// server-specific
-		ctx = SSL_CTX_new(TLS_server_method());
-		if (ctx == nullptr) {
-			ERR_print_errors_fp(stderr);
-			exit(1);
-		}
+		if (tls) {
+			ctx = SSL_CTX_new(TLS_server_method());
+			if (ctx == nullptr) {
+				ERR_print_errors_fp(stderr);
+				exit(1);
+			}
 
-		if (SSL_CTX_use_certificate_chain_file(ctx, certificate_chain_file.c_str()) <= 0) {
-			SSL_CTX_free(ctx);
-			ERR_print_errors_fp(stderr);
-			perror("Failed to load the server certificate chain file");
-			exit(1);
-		}
+			if (SSL_CTX_use_certificate_chain_file(ctx, certificate_chain_file.c_str()) <= 0) {
+				SSL_CTX_free(ctx);
+				ERR_print_errors_fp(stderr);
+				perror("Failed to load the server certificate chain file");
+				exit(1);
+			}
 
-		if (SSL_CTX_use_PrivateKey_file(ctx, private_key_file.c_str(), SSL_FILETYPE_PEM) <= 0) {
-			SSL_CTX_free(ctx);
-			ERR_print_errors_fp(stderr);
-			perror("Error loading the server private key file, "
-			       "possible key/cert mismatch???");
-		}
+			if (SSL_CTX_use_PrivateKey_file(ctx, private_key_file.c_str(), SSL_FILETYPE_PEM) <= 0) {
+				SSL_CTX_free(ctx);
+				ERR_print_errors_fp(stderr);
+				perror("Error loading the server private key file, "
+				       "possible key/cert mismatch???");
+			}
 
-		SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+			SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+			if (ktls) {
+				enable_ktls();
+			}
+		}
 
 		struct sockaddr_in dest;
 		struct sockaddr_in serv;
@@ -165,9 +214,19 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 			perror("error: listen");
 			exit(1);
 		}
+		io::Deadline deadline(timeout);
+		if (!deadline.waitReadable(mysocket)) {
+			throw std::runtime_error("No party connected to port " + std::to_string(port) + " within " +
+			                         deadline.describe());
+		}
 		consocket = accept(mysocket, (struct sockaddr *)&dest, &socksize);
 		// close(mysocket);
 
+		if (!tls) {
+			init_plain(quiet);
+			return;
+		}
+
 		// wrap consocket in BIO
 		// BIO *raw_bio = BIO_new(BIO_s_socket());
 		// BIO_set_fd(raw_bio, consocket, BIO_NOCLOSE); // TODO maybe BIO_CLOSE
@@ -185,11 +244,18 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 		// SSL_set_bio(ssl, raw_bio, raw_bio);
 
 		// perform handshake
+		deadline.applyTimeouts(consocket);
 		if (SSL_accept(ssl) <= 0) {
 			ERR_print_errors_fp(stderr);
 			SSL_free(ssl);
+			if (deadline.expired()) {
+				throw std::runtime_error("SSL handshake on port " + std::to_string(port) + " timed out");
+			}
                         throw std::runtime_error("Error performing SSL handshake with client");
 		}
+		io::Deadline::clearTimeouts(consocket);
+
+		check_ktls();
 
 		// wrap SSL in BIO
 		BIO *ssl_bio = BIO_new(BIO_f_ssl());
@@ -210,6 +276,30 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 			std::cout << "connected\n";
 	}
 
+	// Buffers directly on the socket for a connection without TLS.
+	void init_plain(bool quiet) {
+		BIO *sock_bio = BIO_new_socket(consocket, BIO_NOCLOSE);
+		set_nodelay();
+		buf_bio = BIO_new(BIO_f_buffer());
+		BIO_set_buffer_size(buf_bio, NETWORK_BUFFER_SIZE);
+		BIO_push(buf_bio, sock_bio);
+
+		if(!quiet)
+			std::cout << "connected\n";
+	}
+
+	void enable_ktls() {
+#ifdef SSL_OP_ENABLE_KTLS
+		SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+	}
+
+	// Records which directions OpenSSL handed to the kernel after the handshake.
+	void check_ktls() {
+		ktls_send = BIO_get_ktls_send(SSL_get_wbio(ssl));
+		ktls_recv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+	}
+
 	void sync() {
 		int tmp = 0;
 		if(is_server) {
@@ -245,6 +335,21 @@ class TLSNetIO: public IOChannel<TLSNetIO> { public:
 	}
 
 	void send_data_internal(const void * data, size_t len) {
+		if (ktls_send && len >= NETWORK_BUFFER_SIZE) {
+			// The kernel encrypts, so hand large buffers to it directly
+			// instead of copying them into the buffer BIO first.
+			BIO_flush(buf_bio);
+			size_t sent = 0;
+			while (sent < len) {
+				size_t res = 0;
+				if (SSL_write_ex(ssl, sent + (const char*)data, len - sent, &res) <= 0) {
+					error("net_send_data\n");
+				}
+				sent += res;
+			}
+			has_sent = true;
+			return;
+		}
 		size_t sent = 0;
 		while(sent < len) {
 			// size_t res = fwrite(sent + (char*)data, 1, len - sent, stream);
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "net_channel.h"
+
+namespace io {
+
+// Network conditions emulated by WanNetIO, e.g., latency_ms = 50,
+// jitter_ms = 3 and bandwidth_mbit = 100 for the WAN setting of
+// local_demo/network_wan.sh.
+struct WanProfile {
+  // One-way delay of each packet in milliseconds
+  double latency_ms = 0;
+  // Each packet is delayed by up to this many milliseconds more or less than
+  // latency_ms, uniformly distributed
+  double jitter_ms = 0;
+  // Bandwidth in MBit/s, 0 for unlimited
+  double bandwidth_mbit = 0;
+
+  bool enabled() const { return latency_ms > 0 || jitter_ms > 0 || bandwidth_mbit > 0; }
+};
+
+// Decorator emulating a wide area network on top of any other channel, so
+// that WAN measurements need neither tc nor special privileges.
+//
+// Sent data is cut into packets on flush(), or once enough data is pending.
+// Each packet leaves when a token bucket filled at the configured bandwidth
+// holds enough bytes for it, and arrives the one-way latency plus jitter
+// later. Packets are kept in a queue ordered by their arrival time, from
+// which a thread passes them on to the underlying channel when due. As with
+// TCP, packets never overtake each other, so jitter only delays. Receiving
+// goes to the underlying channel directly, the delays are all applied by the
+// sending side.
+//
+// Like a full TCP window, send_data blocks once too much data is queued.
+class WanNetIO : public NetChannel {
+  using Clock = std::chrono::steady_clock;
+
+  // Size of the packets larger messages are cut into, so the start of a
+  // message arrives before its end as on a real link
+  static constexpr size_t PACKET_SIZE = 1 << 16;
+  // Capacity of the token bucket, i.e., bytes that can leave at once after
+  // the link was idle
+  static constexpr double BURST_BYTES = PACKET_SIZE;
+  // Queued bytes at which send_data waits for packets to be delivered
+  static constexpr size_t MAX_QUEUED = 64 << 20;
+
+  struct Packet {
+    Clock::time_point arrival;
+    std::vector<char> data;
+  };
+
+  std::unique_ptr<NetChannel> inner_;
+  WanProfile profile_;
+  // Sent data not yet cut into packets
+  std::vector<char> pending_;
+  // Token bucket limiting the bandwidth. Tokens are bytes and may become
+  // negative for packets larger than the bucket, which then delays the
+  // following packets until the debt is paid off.
+  double tokens_ = BURST_BYTES;
+  Clock::time_point refilled_ = Clock::now();
+  Clock::time_point last_arrival_ = Clock::now();
+  std::mt19937_64 rng_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<Packet> queue_;
+  size_t queued_bytes_ = 0;
+  bool delivering_ = false;
+  bool stop_ = false;
+  // Error of the underlying channel, thrown by the next call of the sender
+  std::exception_ptr error_;
+  std::thread deliverer_;
+
+  // Time at which the last byte of a packet of len bytes left
+  Clock::time_point departure(size_t len, Clock::time_point now) {
+    if (profile_.bandwidth_mbit <= 0) {
+      return now;
+    }
+    double rate = profile_.bandwidth_mbit * 1e6 / 8;
+    tokens_ = std::min(BURST_BYTES, tokens_ + rate * std::chrono::duration<double>(now - refilled_).count());
+    refilled_ = now;
+    tokens_ -= static_cast<double>(len);
+    if (tokens_ >= 0) {
+      return now;
+    }
+    return now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-tokens_ / rate));
+  }
+
+  Clock::time_point arrival(size_t len) {
+    auto now = Clock::now();
+    double delay_ms = profile_.latency_ms;
+    if (profile_.jitter_ms > 0) {
+      delay_ms += std::uniform_real_distribution<double>(-profile_.jitter_ms, profile_.jitter_ms)(rng_);
+    }
+    auto at = departure(len, now) +
+              std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(std::max(0.0, delay_ms)));
+    last_arrival_ = std::max(at, last_arrival_);
+    return last_arrival_;
+  }
+
+  void throwIfFailed() {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+  void enqueue(const char* data, size_t len) {
+    Packet packet{arrival(len), std::vector<char>(data, data + len)};
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&]() { return queued_bytes_ < MAX_QUEUED || error_; });
+    throwIfFailed();
+    queued_bytes_ += len;
+    queue_.push_back(std::move(packet));
+    changed_.notify_all();
+  }
+
+  void enqueuePending() {
+    for (size_t pos = 0; pos < pending_.size(); pos += PACKET_SIZE) {
+      enqueue(pending_.data() + pos, std::min(PACKET_SIZE, pending_.size() - pos));
+    }
+    pending_.clear();
+  }
+
+  void deliver() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (queue_.empty()) {
+        if (stop_) {
+          return;
+        }
+        changed_.wait(lock);
+        continue;
+      }
+      if (Clock::now() < queue_.front().arrival) {
+        changed_.wait_until(lock, queue_.front().arrival);
+        continue;
+      }
+
+      auto packet = std::move(queue_.front());
+      queue_.pop_front();
+      delivering_ = true;
+      lock.unlock();
+      try {
+        inner_->send_data(packet.data.data(), packet.data.size());
+        inner_->flush();
+      } catch (...) {
+        lock.lock();
+        error_ = std::current_exception();
+        delivering_ = false;
+        changed_.notify_all();
+        return;
+      }
+      lock.lock();
+      delivering_ = false;
+      queued_bytes_ -= packet.data.size();
+      changed_.notify_all();
+    }
+  }
+
+ public:
+  WanNetIO(std::unique_ptr<NetChannel> inner, const WanProfile& profile)
+      : inner_(std::move(inner)), profile_(profile), deliverer_(&WanNetIO::deliver, this) {}
+
+  // Delivers all data sent so far, at the emulated times, before closing.
+  ~WanNetIO() override {
+    try {
+      enqueuePending();
+    } catch (...) {
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      changed_.notify_all();
+    }
+    deliverer_.join();
+  }
+
+  void send_data_internal(const void* data, size_t len) override {
+    auto* bytes = static_cast<const char*>(data);
+    pending_.insert(pending_.end(), bytes, bytes + len);
+    if (pending_.size() >= PACKET_SIZE) {
+      enqueuePending();
+    }
+  }
+
+  void recv_data_internal(void* data, size_t len) override { inner_->recv_data(data, len); }
+
+  void flush() override {
+    if (!pending_.empty()) {
+      enqueuePending();
+    }
+  }
+
+  // Waits until all packets arrived, the synchronization itself is not delayed.
+  void sync() override {
+    flush();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [&]() { return (queue_.empty() && !delivering_) || error_; });
+      throwIfFailed();
+    }
+    inner_->sync();
+  }
+};
+
+};  // namespace io
@@ -1,5 +1,6 @@
 #include "circuit.h"
 
+#include <sstream>
 #include <stdexcept>
 
 namespace common::utils {
@@ -181,6 +182,14 @@ std::ostream& operator<<(std::ostream& os, GateType type) {
       os << "ReorderInverse";
       break;
 
+    case kEqualsZero:
+      os << "EqualsZero";
+      break;
+
+    case kConvertB2A:
+      os << "ConvertB2A";
+      break;
+
     default:
       os << "Invalid";
       break;
@@ -188,6 +197,93 @@ std::ostream& operator<<(std::ostream& os, GateType type) {
   return os;
 }
 
+std::string toString(GateType type) {
+  std::ostringstream os;
+  os << type;
+  return os.str();
+}
+
+// FNV-1a
+static void hashValue(uint64_t& hash, uint64_t val) {
+  for (int i = 0; i < 8; ++i) {
+    hash ^= (val >> (8 * i)) & 0xff;
+    hash *= 0x100000001b3ULL;
+  }
+}
+
+static void hashWires(uint64_t& hash, const std::vector<wire_t>& wires) {
+  hashValue(hash, wires.size());
+  for (auto w : wires) {
+    hashValue(hash, w);
+  }
+}
+
+uint64_t LevelOrderedCircuit::fingerprint() const {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hashValue(hash, num_gates);
+  hashValue(hash, num_wires);
+  hashWires(hash, outputs);
+  hashWires(hash, output_bin);
+  hashValue(hash, gates_by_level.size());
+  for (const auto& level : gates_by_level) {
+    hashValue(hash, level.size());
+    for (const auto& gate : level) {
+      hashValue(hash, gate->type);
+      hashValue(hash, gate->gid);
+      hashValue(hash, gate->out);
+      hashWires(hash, gate->outs);
+      if (auto* g = dynamic_cast<const FIn1Gate*>(gate.get())) {
+        hashValue(hash, g->in);
+      } else if (auto* g = dynamic_cast<const ParamFIn1Gate*>(gate.get())) {
+        hashValue(hash, g->in);
+        hashValue(hash, g->param);
+      } else if (auto* g = dynamic_cast<const FIn2Gate*>(gate.get())) {
+        hashValue(hash, g->in1);
+        hashValue(hash, g->in2);
+      } else if (auto* g = dynamic_cast<const FIn3Gate*>(gate.get())) {
+        hashValue(hash, g->in1);
+        hashValue(hash, g->in2);
+        hashValue(hash, g->in3);
+      } else if (auto* g = dynamic_cast<const FIn4Gate*>(gate.get())) {
+        hashValue(hash, g->in1);
+        hashValue(hash, g->in2);
+        hashValue(hash, g->in3);
+        hashValue(hash, g->in4);
+      } else if (auto* g = dynamic_cast<const SIMDGate*>(gate.get())) {
+        hashWires(hash, g->in1);
+        hashWires(hash, g->in2);
+      } else if (auto* g = dynamic_cast<const SIMDSingleOutGate*>(gate.get())) {
+        hashWires(hash, g->in1);
+      } else if (auto* g = dynamic_cast<const SIMDOGate*>(gate.get())) {
+        hashWires(hash, g->in1);
+      } else if (auto* g = dynamic_cast<const SIMDODoubleInGate*>(gate.get())) {
+        hashWires(hash, g->in1);
+        hashWires(hash, g->in2);
+      } else if (auto* g = dynamic_cast<const ParamSIMDOGate*>(gate.get())) {
+        hashWires(hash, g->in1);
+        hashValue(hash, g->param);
+      } else if (auto* g = dynamic_cast<const TwoParamSIMDOGate*>(gate.get())) {
+        hashWires(hash, g->in1);
+        hashValue(hash, g->param1);
+        hashValue(hash, g->param2);
+      } else if (auto* g = dynamic_cast<const ThreeParamSIMDOGate*>(gate.get())) {
+        hashWires(hash, g->in1);
+        hashValue(hash, g->param1);
+        hashValue(hash, g->param2);
+        hashValue(hash, g->param3);
+      } else if (auto* g = dynamic_cast<const ParamWithFlagSIMDOGate*>(gate.get())) {
+        hashWires(hash, g->in1);
+        hashValue(hash, g->param);
+        hashValue(hash, g->flag);
+      } else if (auto* g = dynamic_cast<const ConstOpGate<Ring>*>(gate.get())) {
+        hashValue(hash, g->in);
+        hashValue(hash, g->cval);
+      }
+    }
+  }
+  return hash;
+}
+
 std::ostream& operator<<(std::ostream& os, const LevelOrderedCircuit& circ) {
   for (size_t i = 0; i < GateType::NumGates; ++i) {
     os << GateType(i) << ": " << circ.count[i] << "\n";
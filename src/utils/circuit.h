@@ -7,6 +7,7 @@
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <string>
 #include <stdexcept>
 #include <type_traits>
 #include <unordered_map>
@@ -63,6 +64,8 @@ enum GateType {
 };
 
 std::ostream& operator<<(std::ostream& os, GateType type);
+// Name of the gate type as printed by operator<<
+std::string toString(GateType type);
 
 // Gates represent primitive operations.
 // All gates have one output.
@@ -245,6 +248,10 @@ struct LevelOrderedCircuit {
   std::vector<wire_t> outputs, output_bin;
   std::vector<std::vector<gate_ptr_t>> gates_by_level;
 
+  // Hash over the structure of the circuit (gates, wires, parameters and
+  // level assignment), e.g., to match stored preprocessing to a circuit.
+  uint64_t fingerprint() const;
+
   friend std::ostream& operator<<(std::ostream& os,
                                   const LevelOrderedCircuit& circ);
 };
@@ -692,6 +699,26 @@ class Circuit {
           break;
         }
 
+        case GateType::kDotprod: {
+          const auto* g = static_cast<SIMDGate*>(gate.get());
+          size_t gate_depth = 0;
+
+          for (size_t i = 0; i < g->in1.size(); i++) {
+            gate_depth = std::max(
+                {wire_level[g->in1[i]], wire_level[g->in2[i]], gate_depth});
+          }
+          gate_depth += 1;
+
+          gate_level[g->gid] = gate_depth;
+          wire_level[g->out] = gate_depth;
+
+          if (DEPTH_ASSIGN_VERBOSE) 
+            std::cout << "DEPTH ASSIGN dotprod gate at depth " << gate_depth << std::endl;
+
+          depth = std::max(depth, gate_depth);
+          break;
+        }
+
         case GateType::kConstAdd:
         case GateType::kConstMul: {
           const auto* g = static_cast<ConstOpGate<R>*>(gate.get());